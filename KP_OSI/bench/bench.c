@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include "../shared/protocol.h"
+#include "../shared/arena.h"
+#include "../shared/board.h"
+#include "../shared/channel.h"
+#include "../shared/events.h"
+#include "../shared/shard.h"
+#include "../shared/wire.h"
+
+// Гистограмма задержек: на каждую степень двойки наносекунд 16 корзин,
+// погрешность процентилей не больше 1/16
+#define HIST_SUB 16
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+// Результаты одного процесса-игрока (в общей анонимной памяти)
+typedef struct {
+    uint64_t games;             // Завершенных игр (считает создатель)
+    uint64_t shots;
+    uint64_t full_retries;      // Сколько раз сервер ответил REPLY_FULL
+    uint64_t errors;
+    uint64_t max_ns;
+    uint64_t hist[HIST_BUCKETS];
+} BenchResult;
+
+// Передача id новой игры от создателя к присоединяющемуся
+typedef struct {
+    uint32_t seq;               // futex: увеличивается с каждой новой игрой
+    int32_t game_id;
+} PairSlot;
+
+typedef struct {
+    int pairs;
+    int duration;
+    unsigned seed;
+    int gateway_port;           // Нагрузка через шлюз на этот порт (0 - напрямую)
+    int connections;            // Соединений со шлюзом
+    int shard;                  // Шард, который нагружается напрямую
+} BenchConfig;
+
+// Соединение с шлюзом: один запрос в полете
+typedef struct {
+    int fd;
+    uint32_t tag;               // Тег запроса в полете
+    uint64_t sent_at;
+    bool logged_in;
+    size_t in_len;
+    char in[sizeof(WireHeader) + sizeof(WireReply)];
+} GatewayConn;
+
+BenchConfig config = { 4, 10, 1, 0, 1000, 0 };
+ShmArena arena;
+SharedData* shared = NULL;
+int my_channel = -1;
+struct timespec deadline;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int time_is_up() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline.tv_sec ||
+           (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+static int hist_bucket(uint64_t ns) {
+    if (ns < HIST_SUB) {
+        return ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    int sub = (ns >> (exp - 4)) & (HIST_SUB - 1);
+    return (exp - 3) * HIST_SUB + sub;
+}
+
+// Середина корзины в наносекундах
+static double hist_value(int bucket) {
+    if (bucket < HIST_SUB) {
+        return bucket;
+    }
+    int exp = bucket / HIST_SUB + 3;
+    int sub = bucket % HIST_SUB;
+    double low = (double)((uint64_t)1 << exp) * (1.0 + sub / (double)HIST_SUB);
+    return low + (double)((uint64_t)1 << exp) / HIST_SUB / 2;
+}
+
+static double hist_percentile(const uint64_t* hist, uint64_t total, double pct) {
+    uint64_t rank = (uint64_t)(total * pct / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank) {
+            return hist_value(i);
+        }
+    }
+    return 0;
+}
+
+// Чтение положительного числа из строки (0 - ошибка)
+static int parse_positive(const char* value) {
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (*end != '\0' || n <= 0 || n > 100000) {
+        return 0;
+    }
+    return (int)n;
+}
+
+int parse_config(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pairs") == 0 && i + 1 < argc) {
+            config.pairs = parse_positive(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            config.duration = parse_positive(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = parse_positive(argv[++i]);
+        } else if (strcmp(argv[i], "--gateway") == 0 && i + 1 < argc) {
+            config.gateway_port = parse_positive(argv[++i]);
+            if (config.gateway_port == 0 || config.gateway_port > 65535) {
+                fprintf(stderr, "Port must be a number from 1 to 65535\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            config.connections = parse_positive(argv[++i]);
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            char* end;
+            long shard = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || shard < 0 || shard >= MAX_SHARDS) {
+                fprintf(stderr, "Shard must be a number from 0 to %d\n", MAX_SHARDS - 1);
+                return -1;
+            }
+            config.shard = (int)shard;
+        } else {
+            fprintf(stderr, "Usage: %s [--pairs N] [--duration SEC] [--seed N] [--shard K]\n"
+                            "       %s --gateway PORT [--connections N] [--duration SEC] [--seed N]\n",
+                    argv[0], argv[0]);
+            return -1;
+        }
+    }
+    
+    if (config.pairs == 0 || config.duration == 0 || config.seed == 0 || config.connections == 0) {
+        fprintf(stderr, "Options must be positive numbers\n");
+        return -1;
+    }
+    return 0;
+}
+
+int connect_to_server() {
+    int shard_count = shard_count_lookup();
+    if (config.shard >= shard_count) {
+        fprintf(stderr, "There are only %d shards\n", shard_count);
+        return -1;
+    }
+    int fd = shard_open(config.shard, shard_count, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "Server is not running\n");
+        return -1;
+    }
+    
+    if (arena_attach(&arena, fd, PROT_READ | PROT_WRITE) < 0) {
+        fprintf(stderr, "Shared memory not properly initialized by server\n");
+        close(fd);
+        return -1;
+    }
+    shared = arena.shared;
+    
+    my_channel = channel_open(shared);
+    if (my_channel < 0) {
+        fprintf(stderr, "No free channels (start the server with more --max-players)\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Команда серверу; задержка выстрелов попадает в гистограмму
+int send_command(Command* cmd, Reply* reply, BenchResult* result) {
+    uint64_t start = now_ns();
+    if (channel_call(shared, my_channel, cmd, reply) < 0) {
+        result->errors++;
+        return -1;
+    }
+    
+    if (cmd->type == CMD_SHOT) {
+        uint64_t elapsed = now_ns() - start;
+        result->hist[hist_bucket(elapsed)]++;
+        if (elapsed > result->max_ns) {
+            result->max_ns = elapsed;
+        }
+    }
+    return 0;
+}
+
+// Случайная расстановка: сначала на локальном флоте, затем через сервер
+int place_fleet(unsigned* seed, BenchResult* result) {
+    Fleet fleet;
+    
+    while (1) {
+        memset(&fleet, 0, sizeof(fleet));
+        int attempts = 0;
+        while (fleet.ships_count < TOTAL_SHIPS && attempts < 1000) {
+            int size = fleet_next_ship_size(&fleet);
+            int x = rand_r(seed) % BOARD_SIZE;
+            int y = rand_r(seed) % BOARD_SIZE;
+            ShipDirection dir = rand_r(seed) % 2 ? DIR_VERTICAL : DIR_HORIZONTAL;
+            if (fleet_can_place(&fleet, x, y, size, dir)) {
+                fleet_place(&fleet, x, y, size, dir);
+            }
+            attempts++;
+        }
+        if (fleet.ships_count == TOTAL_SHIPS) {
+            break;
+        }
+    }
+    
+    for (int i = 0; i < TOTAL_SHIPS; i++) {
+        // Первая клетка корабля - младший бит маски, направление - по соседней клетке
+        Bitboard mask = fleet.ship_mask[i];
+        int cell = 0;
+        while (!((mask >> cell) & 1)) {
+            cell++;
+        }
+        int vertical = ((mask >> (cell + BOARD_SIZE)) & 1) != 0;
+        
+        Command cmd = { .type = CMD_PLACE_SHIP, .x = cell % BOARD_SIZE, .y = cell / BOARD_SIZE,
+                        .dir = vertical ? DIR_VERTICAL : DIR_HORIZONTAL };
+        Reply reply;
+        if (send_command(&cmd, &reply, result) < 0 || reply.status != REPLY_OK) {
+            result->errors++;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Короткий сон на move_seq, чтобы не пропустить конец теста
+static const struct timespec wait_timeout = { 0, 100000000 };
+
+// Ожидание хода без блокировок: поля читаются атомарно, между проверками
+// игрок спит на move_seq игры. 1 - наш ход, 0 - игра окончена, -1 - время вышло
+int wait_for_turn(Game* game, uint32_t generation, int player_num) {
+    while (!time_is_up()) {
+        uint32_t seq = __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE);
+        if (!__atomic_load_n(&game->in_use, __ATOMIC_ACQUIRE) ||
+            __atomic_load_n(&game->generation, __ATOMIC_ACQUIRE) != generation) {
+            return 0;
+        }
+        
+        int status = __atomic_load_n(&game->status, __ATOMIC_ACQUIRE);
+        if (status == GAME_FINISHED) {
+            return 0;
+        }
+        if (status == GAME_PLAYING &&
+            __atomic_load_n(&game->current_turn, __ATOMIC_ACQUIRE) == player_num) {
+            return 1;
+        }
+        wait_game_change(game, seq, &wait_timeout);
+    }
+    return -1;
+}
+
+// Одна игра с точки зрения игрока. 1 - игра завершена, 0 - время вышло
+int play_game(int game_id, uint32_t generation, int player_num, unsigned* seed,
+              BenchResult* result) {
+    Game* game = arena_game(&arena, game_id);
+    Bitboard shot = 0;
+    
+    // Расставлять корабли можно только после прихода второго игрока
+    while (1) {
+        uint32_t seq = __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&game->status, __ATOMIC_ACQUIRE) != GAME_WAITING) {
+            break;
+        }
+        if (time_is_up()) {
+            return 0;
+        }
+        wait_game_change(game, seq, &wait_timeout);
+    }
+    
+    if (place_fleet(seed, result) < 0) {
+        return 0;
+    }
+    
+    while (1) {
+        int turn = wait_for_turn(game, generation, player_num);
+        if (turn <= 0) {
+            return turn == 0;
+        }
+        
+        // Случайная клетка, куда еще не стреляли
+        int cell;
+        do {
+            cell = rand_r(seed) % (BOARD_SIZE * BOARD_SIZE);
+        } while ((shot >> cell) & 1);
+        
+        Command cmd = { .type = CMD_SHOT, .x = cell % BOARD_SIZE, .y = cell / BOARD_SIZE };
+        Reply reply;
+        if (send_command(&cmd, &reply, result) < 0) {
+            return 0;
+        }
+        
+        if (reply.status == REPLY_NOT_YOUR_TURN) {
+            continue;
+        }
+        if (reply.status != REPLY_OK) {
+            result->errors++;
+            return 0;
+        }
+        
+        shot |= (Bitboard)1 << cell;
+        result->shots++;
+        
+        if (reply.game_status == GAME_FINISHED) {
+            return 1;
+        }
+    }
+}
+
+int login(const char* name, BenchResult* result) {
+    Command cmd = { .type = CMD_LOGIN };
+    snprintf(cmd.name, sizeof(cmd.name), "%s", name);
+    Reply reply;
+    if (send_command(&cmd, &reply, result) < 0 || reply.status != REPLY_OK) {
+        fprintf(stderr, "Login failed for %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+void logout(BenchResult* result) {
+    Command cmd = { .type = CMD_LEAVE_GAME };
+    Reply reply;
+    send_command(&cmd, &reply, result);
+    
+    cmd.type = CMD_LOGOUT;
+    if (send_command(&cmd, &reply, result) == 0) {
+        channel_close(shared, my_channel);
+    }
+}
+
+// Создатель игр: создает игру, сообщает ее id напарнику и играет первым
+void run_creator(int pair, PairSlot* slot, BenchResult* result) {
+    unsigned seed = config.seed * 7919 + pair * 2;
+    char name[MAX_NAME];
+    
+    snprintf(name, sizeof(name), "b%d-%da", (int)getpid(), pair);
+    if (login(name, result) < 0) {
+        return;
+    }
+    
+    for (int round = 0; !time_is_up(); round++) {
+        Command cmd = { .type = CMD_CREATE_GAME };
+        snprintf(cmd.name, sizeof(cmd.name), "b%d-%d-%d", (int)getpid(), pair, round);
+        Reply reply;
+        if (send_command(&cmd, &reply, result) < 0) {
+            break;
+        }
+        
+        // Все слоты заняты завершенными играми, ждем их освобождения
+        if (reply.status == REPLY_FULL) {
+            result->full_retries++;
+            usleep(10000);
+            continue;
+        }
+        if (reply.status != REPLY_OK) {
+            result->errors++;
+            break;
+        }
+        
+        __atomic_store_n(&slot->game_id, reply.game_id, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&slot->seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&slot->seq, 1);
+        
+        if (play_game(reply.game_id, reply.game_gen, 1, &seed, result)) {
+            result->games++;
+        }
+    }
+    
+    logout(result);
+}
+
+// Присоединяющийся: ждет новую игру напарника и играет вторым
+void run_joiner(int pair, PairSlot* slot, BenchResult* result) {
+    unsigned seed = config.seed * 7919 + pair * 2 + 1;
+    char name[MAX_NAME];
+    uint32_t seen = 0;
+    
+    snprintf(name, sizeof(name), "b%d-%db", (int)getpid(), pair);
+    if (login(name, result) < 0) {
+        return;
+    }
+    
+    while (!time_is_up()) {
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == seen) {
+            struct timespec timeout = { 0, 100000000 };
+            futex_wait(&slot->seq, seq, &timeout);
+            continue;
+        }
+        seen = seq;
+        
+        Command cmd = { .type = CMD_JOIN_GAME,
+                        .game_id = __atomic_load_n(&slot->game_id, __ATOMIC_RELAXED) };
+        Reply reply;
+        if (send_command(&cmd, &reply, result) < 0) {
+            break;
+        }
+        if (reply.status != REPLY_OK) {
+            result->errors++;
+            continue;
+        }
+        
+        play_game(reply.game_id, reply.game_gen, 2, &seed, result);
+    }
+    
+    logout(result);
+}
+
+void print_report(BenchResult* results, int count, double seconds) {
+    BenchResult total;
+    memset(&total, 0, sizeof(total));
+    
+    for (int i = 0; i < count; i++) {
+        total.games += results[i].games;
+        total.shots += results[i].shots;
+        total.full_retries += results[i].full_retries;
+        total.errors += results[i].errors;
+        if (results[i].max_ns > total.max_ns) {
+            total.max_ns = results[i].max_ns;
+        }
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            total.hist[b] += results[i].hist[b];
+        }
+    }
+    
+    double p50 = hist_percentile(total.hist, total.shots, 50) / 1000.0;
+    double p99 = hist_percentile(total.hist, total.shots, 99) / 1000.0;
+    double p999 = hist_percentile(total.hist, total.shots, 99.9) / 1000.0;
+    
+    printf("\n=== Sea Battle Benchmark ===\n");
+    printf("Players: %d (%d pairs), duration: %.1f s\n", count, config.pairs, seconds);
+    printf("Games: %llu (%.1f/s)\n", (unsigned long long)total.games, total.games / seconds);
+    printf("Shots: %llu (%.1f/s)\n", (unsigned long long)total.shots, total.shots / seconds);
+    printf("Turn latency (us): p50=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+           p50, p99, p999, total.max_ns / 1000.0);
+    printf("Server full retries: %llu, errors: %llu\n",
+           (unsigned long long)total.full_retries, (unsigned long long)total.errors);
+    
+    // Одна строка для скриптов отслеживания регрессий
+    printf("RESULT games_per_sec=%.1f shots_per_sec=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f\n",
+           total.games / seconds, total.shots / seconds, p50, p99, p999);
+}
+
+// ===== Нагрузка через шлюз =====
+
+// Запрос по соединению шлюза: вход (первый раз) или CMD_LEAVE_GAME -
+// команда без игры, которая все равно проходит через сервер
+static int gateway_send(GatewayConn* conn, int idx) {
+    char msg[sizeof(WireHeader) + sizeof(WireCommand)];
+    WireCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    if (conn->logged_in) {
+        cmd.type = CMD_LEAVE_GAME;
+    } else {
+        cmd.type = CMD_LOGIN;
+        cmd.name_len = snprintf(cmd.name, sizeof(cmd.name), "gw%u_%d", config.seed, idx);
+    }
+    
+    WireHeader header = { .length = WIRE_COMMAND_MIN + cmd.name_len, .type = WIRE_COMMAND,
+                          .tag = ++conn->tag };
+    memcpy(msg, &header, sizeof(header));
+    memcpy(msg + sizeof(header), &cmd, header.length);
+    
+    conn->sent_at = now_ns();
+    size_t size = sizeof(header) + header.length;
+    return send(conn->fd, msg, size, MSG_NOSIGNAL) == (ssize_t)size ? 0 : -1;
+}
+
+static int gateway_connect() {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.gateway_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Ответы соединения; на каждый сразу уходит следующий запрос
+static void gateway_receive(GatewayConn* conn, int idx, BenchResult* result) {
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - conn->in_len, 0);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            result->errors++;
+            close(conn->fd);
+            conn->fd = -1;
+        }
+        return;
+    }
+    conn->in_len += n;
+    if (conn->in_len < sizeof(conn->in)) {
+        return;
+    }
+    conn->in_len = 0;
+    
+    WireHeader header;
+    WireReply reply;
+    memcpy(&header, conn->in, sizeof(header));
+    memcpy(&reply, conn->in + sizeof(header), sizeof(reply));
+    if (header.type != WIRE_REPLY || header.tag != conn->tag || reply.status != REPLY_OK) {
+        result->errors++;
+        
+        // Без входа остальные команды бессмысленны
+        if (!conn->logged_in) {
+            close(conn->fd);
+            conn->fd = -1;
+            return;
+        }
+    }
+    
+    if (conn->logged_in) {
+        uint64_t elapsed = now_ns() - conn->sent_at;
+        result->shots++;
+        result->hist[hist_bucket(elapsed)]++;
+        if (elapsed > result->max_ns) {
+            result->max_ns = elapsed;
+        }
+    }
+    conn->logged_in = true;
+    
+    if (!time_is_up() && gateway_send(conn, idx) < 0) {
+        result->errors++;
+    }
+}
+
+// Все соединения в одном процессе через epoll: каждое держит
+// один запрос в полете до конца замера. Запросы считаются в shots
+int run_gateway_bench() {
+    int count = config.connections;
+    
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    GatewayConn* conns = calloc(count, sizeof(GatewayConn));
+    BenchResult* result = calloc(1, sizeof(BenchResult));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!conns || !result || epoll_fd < 0) {
+        perror("gateway bench setup failed");
+        return 1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        conns[i].fd = gateway_connect();
+        if (conns[i].fd < 0) {
+            fprintf(stderr, "Connection %d failed: %s\n", i, strerror(errno));
+            return 1;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    }
+    printf("Connected %d clients to the gateway\n", count);
+    
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += config.duration;
+    uint64_t started = now_ns();
+    
+    for (int i = 0; i < count; i++) {
+        if (gateway_send(&conns[i], i) < 0) {
+            result->errors++;
+        }
+    }
+    
+    struct epoll_event events[512];
+    while (!time_is_up()) {
+        int n = epoll_wait(epoll_fd, events, 512, 100);
+        for (int i = 0; i < n; i++) {
+            int idx = events[i].data.u32;
+            if (conns[idx].fd >= 0) {
+                gateway_receive(&conns[idx], idx, result);
+            }
+        }
+    }
+    double seconds = (now_ns() - started) / 1e9;
+    
+    int logged_in = 0;
+    for (int i = 0; i < count; i++) {
+        logged_in += conns[i].logged_in;
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+    }
+    
+    double p50 = hist_percentile(result->hist, result->shots, 50) / 1000.0;
+    double p99 = hist_percentile(result->hist, result->shots, 99) / 1000.0;
+    double p999 = hist_percentile(result->hist, result->shots, 99.9) / 1000.0;
+    
+    printf("\n=== Sea Battle Gateway Benchmark ===\n");
+    printf("Connections: %d (%d logged in), duration: %.1f s\n", count, logged_in, seconds);
+    printf("Requests: %llu (%.1f/s)\n", (unsigned long long)result->shots, result->shots / seconds);
+    printf("Request latency (us): p50=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+           p50, p99, p999, result->max_ns / 1000.0);
+    printf("Errors: %llu\n", (unsigned long long)result->errors);
+    printf("RESULT connections=%d requests_per_sec=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f\n",
+           logged_in, result->shots / seconds, p50, p99, p999);
+    
+    int failed = result->errors > 0;
+    close(epoll_fd);
+    free(conns);
+    free(result);
+    return failed;
+}
+
+int main(int argc, char* argv[]) {
+    if (parse_config(argc, argv) < 0) {
+        return 1;
+    }
+    
+    if (config.gateway_port) {
+        return run_gateway_bench();
+    }
+    
+    int players = config.pairs * 2;
+    
+    // Результаты и слоты пар видны и родителю, и всем игрокам
+    size_t results_size = players * sizeof(BenchResult);
+    size_t slots_size = config.pairs * sizeof(PairSlot);
+    void* mem = mmap(NULL, results_size + slots_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap failed");
+        return 1;
+    }
+    BenchResult* results = mem;
+    PairSlot* slots = (PairSlot*)((char*)mem + results_size);
+    
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += config.duration;
+    uint64_t started = now_ns();
+    
+    for (int i = 0; i < players; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed");
+            return 1;
+        }
+        if (pid == 0) {
+            if (connect_to_server() < 0) {
+                _exit(1);
+            }
+            if (i % 2 == 0) {
+                run_creator(i / 2, &slots[i / 2], &results[i]);
+            } else {
+                run_joiner(i / 2, &slots[i / 2], &results[i]);
+            }
+            arena_detach(&arena);
+            _exit(0);
+        }
+    }
+    
+    int failed = 0;
+    int status;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    
+    double seconds = (now_ns() - started) / 1e9;
+    print_report(results, players, seconds);
+    
+    munmap(mem, results_size + slots_size);
+    return failed ? 1 : 0;
+}
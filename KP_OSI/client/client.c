@@ -10,144 +10,326 @@
 #include <pthread.h>
 #include <errno.h>
 #include "../shared/protocol.h"
+#include "../shared/arena.h"
+#include "../shared/board.h"
+#include "../shared/channel.h"
+#include "../shared/events.h"
+#include "../shared/index.h"
+#include "../shared/match.h"
+#include "../shared/movelog.h"
+#include "../shared/replay.h"
+#include "../shared/shard.h"
+#include "../shared/seqlock.h"
+#include "render.h"
 
+ShmArena arena;
 SharedData* shared = NULL;
 int mmap_fd = -1;
 char my_login[MAX_LOGIN] = "";
+int my_player_idx = -1;     // Индекс в players[], не меняется после логина
 int my_game_id = -1;
+uint32_t my_game_gen = 0;   // Поколение слота my_game_id
 int my_player_num = 0;
+int my_channel = -1;        // Канал команд серверу
+int shard_total = 1;        // Число шардов (shard.h)
+int my_shard = 0;           // Шард, к которому подключен клиент
+time_t last_heartbeat = 0;  // Когда клиент последний раз обновил last_seen
+Frame frame;                // Кадр с досками, выводится одним write
 
 // Корабли для расстановки (по правилам)
 int ships_to_place[] = {4, 3, 3, 2, 2, 2, 1, 1, 1, 1};
 int current_ship_index = 0;
 
-// Функции синхронизации с мьютексами
-void lock() {
-    int ret = pthread_mutex_lock(&shared->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "Ошибка блокировки мьютекса: %s\n", strerror(ret));
-        exit(1);
+// Количество созданных игр (читается без глобального мьютекса)
+int get_game_count() {
+    return __atomic_load_n(&shared->game_count, __ATOMIC_ACQUIRE);
+}
+
+// Доступ к записям в арене (сегмент при необходимости доотображается)
+Player* get_player(int idx) {
+    return arena_player(&arena, idx);
+}
+
+Game* get_game(int id) {
+    return arena_game(&arena, id);
+}
+
+void reattach(int prot);
+
+// Обновление времени последней активности: атомарная запись без
+// блокировок, не чаще раза в HEARTBEAT_SEC
+void heartbeat() {
+    time_t now = time(NULL);
+    if (now - last_heartbeat >= HEARTBEAT_SEC) {
+        __atomic_store_n(&get_player(my_player_idx)->last_seen, now, __ATOMIC_RELAXED);
+        last_heartbeat = now;
     }
 }
 
-void unlock() {
-    int ret = pthread_mutex_unlock(&shared->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "Ошибка разблокировки мьютекса: %s\n", strerror(ret));
-        exit(1);
+// Согласованная копия своей игры без блокировок. Возвращает саму игру
+// (для ожидания на move_seq) или NULL, если сервер уже освободил слот
+Game* snapshot_my_game(Game* copy) {
+    if (my_game_id < 0) {
+        return NULL;
+    }
+    
+    Game* game = get_game(my_game_id);
+    game_snapshot(game, copy);
+    
+    // Проверка после копии: остановка, случившаяся позже, еще изменит
+    // move_seq, и ожидание хода не уснет
+    if (server_retired(shared)) {
+        reattach(PROT_READ | PROT_WRITE);
+        return snapshot_my_game(copy);
     }
+    
+    if (!copy->in_use || copy->generation != my_game_gen) {
+        printf("Your game has been closed by the server\n");
+        my_game_id = -1;
+        my_player_num = 0;
+        return NULL;
+    }
+    return game;
 }
 
-// Подключение к shared memory
-int connect_to_server() {
-    // Пробуем подключиться через shm_open
-    mmap_fd = shm_open(SHM_NAME, O_RDWR, 0666);
-    if (mmap_fd < 0) {
-        // Если не получилось, пробуем через файл
-        mmap_fd = open(MMAP_FILE, O_RDWR, 0666);
-        if (mmap_fd < 0) {
-            printf("ERROR: Server is not running!\n");
-            printf("Please start the server first: cd server && ./sea_battle_server\n");
-            return -1;
+// Отправка команды серверу и ожидание ответа. Команда, которую
+// остановленный сервер не выполнил, повторяется на следующем запуске
+int send_command(Command* cmd, Reply* reply) {
+    if (channel_call(shared, my_channel, cmd, reply) == 0) {
+        return 0;
+    }
+    if (server_retired(shared)) {
+        reattach(PROT_READ | PROT_WRITE);
+        if (channel_call(shared, my_channel, cmd, reply) == 0) {
+            return 0;
         }
     }
+    printf("Server is not responding\n");
+    return -1;
+}
+
+// Запоминаем игру, которую сервер вернул в ответе
+void remember_game(const Reply* reply) {
+    my_game_id = reply->game_id;
+    my_game_gen = reply->game_gen;
+    my_player_num = reply->game_id >= 0 ? reply->player_num : 0;
+}
+
+// Подключение к shared memory шарда. Зрителю хватает prot = PROT_READ
+int connect_to_server(int shard, int prot) {
+    int flags = (prot & PROT_WRITE) ? O_RDWR : O_RDONLY;
     
-    // Маппируем shared memory
-    shared = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, mmap_fd, 0);
-    if (shared == MAP_FAILED) {
-        perror("Failed to map shared memory");
-        close(mmap_fd);
+    // Пробуем подключиться через shm_open, затем через файл
+    mmap_fd = shard_open(shard, shard_total, flags);
+    if (mmap_fd < 0) {
+        printf("ERROR: Server is not running!\n");
+        printf("Please start the server first: cd server && ./sea_battle_server\n");
         return -1;
     }
     
-    // Проверяем, инициализирована ли shared memory
-    if (shared->initialized != 12345) {
+    // Маппируем shared memory и проверяем, инициализирована ли она
+    int ret = arena_attach(&arena, mmap_fd, prot);
+    if (ret == -2) {
         printf("Shared memory not properly initialized by server\n");
-        munmap(shared, MMAP_SIZE);
+    }
+    if (ret < 0) {
         close(mmap_fd);
         return -1;
     }
     
+    shared = arena.shared;
+    my_shard = shard;
     return 0;
 }
 
-// Отображение игрового поля (без изменений, как в оригинале)
-void print_board(int board[BOARD_SIZE][BOARD_SIZE], int show_ships) {
-    printf("   ");
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        printf("%2d ", i);
+// Канал и CMD_LOGIN в подключенном сегменте
+int open_session(Reply* reply) {
+    my_channel = channel_open(shared);
+    if (my_channel < 0) {
+        printf("Server is full (no free channels)\n");
+        return -1;
     }
-    printf("\n");
     
-    for (int y = 0; y < BOARD_SIZE; y++) {
-        printf("%2d ", y);
-        for (int x = 0; x < BOARD_SIZE; x++) {
-            char symbol = ' ';
-            switch (board[x][y]) {
-                case CELL_EMPTY:
-                    symbol = '.';
-                    break;
-                case CELL_SHIP:
-                    symbol = show_ships ? 'S' : '.';
-                    break;
-                case CELL_HIT:
-                    symbol = 'X';
-                    break;
-                case CELL_MISS:
-                    symbol = 'O';
-                    break;
-                case CELL_SUNK:
-                    symbol = '#';
-                    break;
-            }
-            printf(" %c ", symbol);
-        }
-        printf("\n");
+    Command cmd = { .type = CMD_LOGIN };
+    strcpy(cmd.name, my_login);
+    if (send_command(&cmd, reply) < 0) {
+        return -1;
+    }
+    
+    if (reply->status == REPLY_FULL) {
+        printf("Server is full (maximum %d players)\n", arena_player_capacity(shared));
+        return -1;
+    }
+    if (reply->status == REPLY_ELSEWHERE) {
+        printf("You are already online on another server\n");
+        return -1;
+    }
+    if (reply->status != REPLY_OK) {
+        printf("Login rejected\n");
+        return -1;
+    }
+    
+    my_player_idx = reply->player_idx;
+    remember_game(reply);
+    return 0;
+}
+
+// Вход на шард: подключение, канал и CMD_LOGIN
+int enter_shard(int shard, Reply* reply) {
+    if (connect_to_server(shard, PROT_READ | PROT_WRITE) < 0) {
+        return -1;
     }
+    return open_session(reply);
 }
 
-// Проверка возможности размещения корабля (без изменений)
-int can_place_ship_here(int board[BOARD_SIZE][BOARD_SIZE], int x, int y, int size, ShipDirection dir) {
-    // Проверка границ
-    if (dir == DIR_HORIZONTAL) {
-        if (x + size > BOARD_SIZE) {
-            return 0;
+// Сервер остановился, сохранив состояние: ждем сегмент следующего запуска
+// (не дольше REATTACH_WAIT_SEC) и входим в него заново. Игры из снимка
+// сохраняют id и поколения, поэтому партия продолжается. Если вернуться
+// не удалось, клиент завершается
+void reattach(int prot) {
+    int game_id = my_game_id;
+    uint32_t game_gen = my_game_gen;
+    
+    printf("\nServer is restarting, reconnecting...\n");
+    fflush(stdout);
+    
+    // Канал и отметка игрока остались в старом сегменте вместе с сервером
+    arena_detach(&arena);
+    close(mmap_fd);
+    shared = NULL;
+    my_channel = -1;
+    
+    // Остановленный сегмент arena_attach не принимает (SHM_RETIRED)
+    int flags = (prot & PROT_WRITE) ? O_RDWR : O_RDONLY;
+    for (int i = 0; i < REATTACH_WAIT_SEC * 10 && !shared; i++) {
+        usleep(100000);
+        mmap_fd = shard_open(my_shard, shard_total, flags);
+        if (mmap_fd < 0) {
+            continue;
         }
-    } else {
-        if (y + size > BOARD_SIZE) {
-            return 0;
+        
+        // epoch = 0: сервер еще загружает снимок
+        int ret = arena_attach(&arena, mmap_fd, prot);
+        if (ret == 0 && __atomic_load_n(&arena.shared->epoch, __ATOMIC_ACQUIRE) != 0) {
+            shared = arena.shared;
+            continue;
+        }
+        if (ret == 0) {
+            arena_detach(&arena);
         }
+        close(mmap_fd);
     }
     
-    // Проверка клеток и области вокруг
-    for (int i = 0; i < size; i++) {
-        int cx = (dir == DIR_HORIZONTAL) ? x + i : x;
-        int cy = (dir == DIR_VERTICAL) ? y + i : y;
-        
-        // Проверка самой клетки
-        if (board[cx][cy] != CELL_EMPTY) {
-            return 0;
+    Reply reply;
+    if (!shared || ((prot & PROT_WRITE) && open_session(&reply) < 0)) {
+        printf("Lost connection to the server\n");
+        exit(1);
+    }
+    
+    if (game_id >= 0 && (my_game_id != game_id || my_game_gen != game_gen)) {
+        printf("Reconnected (server run %u), but your game was not restored\n", shared->epoch);
+    } else {
+        printf("Reconnected (server run %u)\n", shared->epoch);
+    }
+}
+
+// Выход с шарда: игрок оффлайн, канал и сегмент освобождены
+void leave_shard() {
+    if (!shared) {
+        return;
+    }
+    
+    Command cmd = { .type = CMD_LOGOUT };
+    Reply reply;
+    if (my_channel >= 0 && send_command(&cmd, &reply) == 0) {
+        channel_close(shared, my_channel);
+    }
+    my_channel = -1;
+    
+    arena_detach(&arena);
+    shared = NULL;
+    if (mmap_fd >= 0) {
+        close(mmap_fd);
+        mmap_fd = -1;
+    }
+}
+
+// Переход на шард игры (при создании и присоединении).
+// Если войти не удалось, клиент возвращается на прежний шард
+int switch_shard(int shard) {
+    if (shard == my_shard) {
+        return 0;
+    }
+    
+    int old = my_shard;
+    Reply reply;
+    leave_shard();
+    if (enter_shard(shard, &reply) == 0) {
+        return 0;
+    }
+    
+    leave_shard();
+    if (enter_shard(old, &reply) < 0) {
+        printf("Lost connection to the server\n");
+        exit(1);
+    }
+    return -1;
+}
+
+// Арена шарда для просмотра игр: своя или временно отображенная
+// только для чтения (освобождается через close_shard_view)
+ShmArena* open_shard_view(int shard, ShmArena* view) {
+    if (shard == my_shard && shared) {
+        return &arena;
+    }
+    int fd = shard_open(shard, shard_total, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (arena_attach(view, fd, PROT_READ) < 0) {
+        close(fd);
+        return NULL;
+    }
+    return view;
+}
+
+void close_shard_view(ShmArena* view, ShmArena* used) {
+    if (used == view) {
+        arena_detach(view);
+        close(view->fd);
+    }
+}
+
+// Статистика игрока по всем шардам: итог засчитывается на шарде, где
+// шла игра. Чужие сегменты читаются без блокировок, поэтому игрок там
+// ищется перебором, а не по хеш-индексу
+void total_stats(Player* stats) {
+    player_snapshot(get_player(my_player_idx), stats);
+    
+    for (int s = 0; s < shard_total; s++) {
+        if (s == my_shard) {
+            continue;
         }
-        
-        // Проверка соседних клеток (включая диагонали)
-        for (int dx = -1; dx <= 1; dx++) {
-            for (int dy = -1; dy <= 1; dy++) {
-                int nx = cx + dx;
-                int ny = cy + dy;
-                
-                if (nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE) {
-                    if (board[nx][ny] == CELL_SHIP) {
-                        return 0;  // Корабли касаются
-                    }
-                }
+        ShmArena view = { 0 };
+        ShmArena* players = open_shard_view(s, &view);
+        if (!players) {
+            continue;
+        }
+        int count = __atomic_load_n(&players->shared->player_count, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < count; i++) {
+            Player p;
+            player_snapshot(arena_player(players, i), &p);
+            if (p.login_hash == stats->login_hash && strcmp(p.login, stats->login) == 0) {
+                stats->wins += p.wins;
+                stats->losses += p.losses;
+                break;
             }
         }
+        close_shard_view(&view, players);
     }
-    
-    return 1;  // Можно разместить
 }
 
-// Логин игрока
+// Логин игрока: вход на шард, выбранный по логину
 int login_player() {
     printf("Enter your login (3-29 characters): ");
     fgets(my_login, MAX_LOGIN, stdin);
@@ -159,49 +341,17 @@ int login_player() {
     }
     
     // Подключаемся к серверу
-    if (connect_to_server() < 0) {
+    shard_total = shard_count_lookup();
+    Reply reply;
+    if (enter_shard(shard_of(hash_string(my_login), shard_total), &reply) < 0) {
         return -1;
     }
     
-    lock();
-    
-    // Проверяем существующего игрока
-    int player_idx = -1;
-    for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, my_login) == 0) {
-            player_idx = i;
-            break;
-        }
-    }
-    
-    if (player_idx >= 0) {
-        // Игрок уже существует
-        shared->players[player_idx].online = true;
-        shared->players[player_idx].last_seen = time(NULL);
-        my_game_id = shared->players[player_idx].game_id;
-        printf("Welcome back, %s!\n", my_login);
-    } else if (shared->player_count < MAX_PLAYERS) {
-        // Новый игрок
-        Player* p = &shared->players[shared->player_count];
-        strcpy(p->login, my_login);
-        p->wins = 0;
-        p->losses = 0;
-        p->online = true;
-        p->game_id = -1;
-        p->last_seen = time(NULL);
-        p->ships_placed = false;
-        
-        player_idx = shared->player_count;
-        shared->player_count++;
-        
-        printf("Welcome, %s! You are player #%d\n", my_login, shared->player_count);
+    if (reply.is_new) {
+        printf("Welcome, %s! You are player #%d\n", my_login, my_player_idx + 1);
     } else {
-        printf("Server is full (maximum %d players)\n", MAX_PLAYERS);
-        unlock();
-        return -1;
+        printf("Welcome back, %s!\n", my_login);
     }
-    
-    unlock();
     return 0;
 }
 
@@ -212,88 +362,69 @@ void create_game() {
     fgets(name, MAX_NAME, stdin);
     name[strcspn(name, "\n")] = '\0';
     
-    lock();
-    
-    // Проверяем что имя не занято
-    for (int i = 0; i < shared->game_count; i++) {
-        if (strcmp(shared->games[i].name, name) == 0) {
-            printf("Game name '%s' is already taken\n", name);
-            unlock();
-            return;
-        }
+    // Игра создается на шарде, который выбирается по ее имени
+    if (switch_shard(shard_of(hash_string(name), shard_total)) < 0) {
+        printf("Cannot create game\n");
+        return;
     }
     
-    // Проверяем лимит игр
-    if (shared->game_count >= MAX_GAMES) {
-        printf("Maximum number of games reached\n");
-        unlock();
+    Command cmd = { .type = CMD_CREATE_GAME };
+    strcpy(cmd.name, name);
+    Reply reply;
+    if (send_command(&cmd, &reply) < 0) {
         return;
     }
     
-    // Создаем новую игру
-    Game* game = &shared->games[shared->game_count];
-    game->id = shared->game_count;
-    strcpy(game->name, name);
-    strcpy(game->player1, my_login);
-    game->player2[0] = '\0';
-    
-    // Инициализация игры
-    game->status = GAME_WAITING;
-    game->current_turn = 1;
-    game->winner = 0;
-    game->last_move = time(NULL);
-    game->ships_count1 = 0;
-    game->ships_count2 = 0;
-    
-    // Очищаем игровые поля
-    for (int i = 0; i < BOARD_SIZE; i++) {
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            game->board1[i][j] = CELL_EMPTY;
-            game->board2[i][j] = CELL_EMPTY;
-        }
+    if (reply.status == REPLY_NAME_TAKEN) {
+        printf("Game name '%s' is already taken\n", name);
+        return;
     }
-    
-    // Обновляем информацию об игроке
-    for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, my_login) == 0) {
-            shared->players[i].game_id = game->id;
-            break;
-        }
+    if (reply.status == REPLY_FULL) {
+        printf("Maximum number of games reached\n");
+        return;
+    }
+    if (reply.status != REPLY_OK) {
+        printf("Cannot create game\n");
+        return;
     }
     
-    my_game_id = game->id;
-    my_player_num = 1;
-    
-    shared->game_count++;
+    remember_game(&reply);
     
-    printf("Game '%s' created successfully! ID: %d\n", name, game->id);
+    printf("Game '%s' created successfully! ID: %d\n", name,
+           SHARD_GAME_ID(my_game_id, my_shard, shard_total));
     printf("You are Player 1. Waiting for opponent...\n");
-    
-    unlock();
 }
 
 // Присоединение к существующей игре
 void join_game() {
-    lock();
-    
     printf("\n=== Available Games ===\n");
     int available = 0;
-    for (int i = 0; i < shared->game_count; i++) {
-        if (shared->games[i].status == GAME_WAITING) {
-            printf("ID: %d - '%s' created by %s\n", 
-                   i, shared->games[i].name, shared->games[i].player1);
-            available++;
+    for (int s = 0; s < shard_total; s++) {
+        ShmArena view = { 0 };
+        ShmArena* games = open_shard_view(s, &view);
+        if (!games) {
+            continue;
+        }
+        int* ids = malloc(arena_game_limit(games->shared) * sizeof(int));
+        int live = arena_live_games(games, ids);
+        for (int i = 0; i < live; i++) {
+            Game game;
+            game_snapshot(arena_game(games, ids[i]), &game);
+            if (game.in_use && game.status == GAME_WAITING) {
+                printf("ID: %d - '%s' created by %s\n", 
+                       SHARD_GAME_ID(ids[i], s, shard_total), game.name, game.player1);
+                available++;
+            }
         }
+        free(ids);
+        close_shard_view(&view, games);
     }
     
     if (available == 0) {
         printf("No games available to join\n");
-        unlock();
         return;
     }
     
-    unlock();
-    
     printf("\nEnter game ID to join: ");
     int game_id;
     if (scanf("%d", &game_id) != 1) {
@@ -303,349 +434,420 @@ void join_game() {
     }
     getchar();  // Убираем символ новой строки
     
-    lock();
-    
-    if (game_id < 0 || game_id >= shared->game_count) {
+    // Глобальный id указывает шард игры и id слота на нем
+    if (game_id < 0 || switch_shard(game_id % shard_total) < 0) {
+        printf("Invalid game ID\n");
+        return;
+    }
+    game_id /= shard_total;
+    if (game_id >= get_game_count()) {
         printf("Invalid game ID\n");
-        unlock();
         return;
     }
     
-    Game* game = &shared->games[game_id];
+    Command cmd = { .type = CMD_JOIN_GAME, .game_id = game_id };
+    Reply reply;
+    if (send_command(&cmd, &reply) < 0) {
+        return;
+    }
     
-    if (game->status != GAME_WAITING) {
+    if (reply.status != REPLY_OK) {
         printf("This game is not available\n");
-        unlock();
         return;
     }
     
-    if (strlen(game->player2) > 0) {
-        printf("This game already has two players\n");
-        unlock();
+    remember_game(&reply);
+    
+    Game game;
+    if (snapshot_my_game(&game)) {
+        printf("Successfully joined game '%s'!\n", game.name);
+    }
+    printf("You are Player 2. Get ready to place your ships!\n");
+}
+
+// Подбор соперника: заявка уходит в очередь без блокировок, сервер раз
+// в раунд объединяет ждущих игроков с близким рейтингом и сам создает игру
+void find_opponent() {
+    Channel* ch = arena_channel(shared, my_channel);
+    Player me;
+    total_stats(&me);
+    
+    uint32_t seen = __atomic_load_n(&ch->match_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ch->matching, MATCH_SEARCHING, __ATOMIC_RELEASE);
+    if (match_enqueue(shared, my_channel, my_player_idx, match_rating(me.wins, me.losses)) < 0) {
+        __atomic_store_n(&ch->matching, MATCH_IDLE, __ATOMIC_RELEASE);
+        printf("Matchmaking queue is full, try again later\n");
         return;
     }
+    wake_server(shared);
     
-    // Присоединяемся к игре
-    strcpy(game->player2, my_login);
-    game->status = GAME_PLACING_SHIPS;
+    printf("Searching for an opponent (up to %d seconds)...\n", MATCH_WAIT_SEC);
+    fflush(stdout);
     
-    // Обновляем информацию об игроке
-    for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, my_login) == 0) {
-            shared->players[i].game_id = game_id;
-            break;
+    time_t deadline = time(NULL) + MATCH_WAIT_SEC;
+    while (__atomic_load_n(&ch->match_seq, __ATOMIC_ACQUIRE) == seen) {
+        // Заявка осталась в очереди остановленного сервера
+        if (server_retired(shared)) {
+            reattach(PROT_READ | PROT_WRITE);
+            printf("Matchmaking was interrupted, try again\n");
+            return;
         }
+        
+        time_t now = time(NULL);
+        if (now >= deadline + CHANNEL_TIMEOUT_SEC) {
+            __atomic_store_n(&ch->matching, MATCH_IDLE, __ATOMIC_RELEASE);
+            printf("Server is not responding\n");
+            return;
+        }
+        
+        // Отменяем заявку, если сервер ее еще не забрал. Иначе игра
+        // уже создается, и ждем еще немного
+        uint32_t expected = MATCH_SEARCHING;
+        if (now >= deadline &&
+            __atomic_compare_exchange_n(&ch->matching, &expected, MATCH_IDLE, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            printf("No opponent found, try again later\n");
+            return;
+        }
+        
+        struct timespec step = { 1, 0 };
+        futex_wait(&ch->match_seq, seen, &step);
     }
     
-    my_game_id = game_id;
-    my_player_num = 2;
+    // Игру создал сервер, берем ее из своей записи игрока
+    player_snapshot(get_player(my_player_idx), &me);
+    my_game_id = me.game_id;
+    my_game_gen = me.game_gen;
     
-    printf("Successfully joined game '%s'!\n", game->name);
-    printf("You are Player 2. Get ready to place your ships!\n");
+    Game game;
+    if (!snapshot_my_game(&game)) {
+        return;
+    }
+    my_player_num = (game.player1_idx == my_player_idx) ? 1 : 2;
     
-    unlock();
+    if (game.status == GAME_WAITING) {
+        printf("Game '%s' created. Waiting for opponent...\n", game.name);
+        return;
+    }
+    printf("Opponent found! Game '%s': %s vs %s\n", game.name, game.player1, game.player2);
+    printf("You are Player %d. Get ready to place your ships!\n", my_player_num);
 }
 
-// Расстановка кораблей
-void place_ships() {
-    printf("\n=== PLACING SHIPS ===\n");
-    printf("You need to place 10 ships according to the rules:\n");
-    printf("• 1 battleship (4 cells)\n");
-    printf("• 2 cruisers (3 cells each)\n");
-    printf("• 3 destroyers (2 cells each)\n");
-    printf("• 4 boats (1 cell each)\n");
-    printf("Ships cannot touch each other, even diagonally!\n");
+// Бот сервера в соперники для своей ожидающей игры
+void add_bot() {
+    Command cmd = { .type = CMD_ADD_BOT };
+    Reply reply;
+    if (send_command(&cmd, &reply) < 0) {
+        return;
+    }
     
-    current_ship_index = 0;
+    if (reply.status == REPLY_OK) {
+        printf("Computer opponent joined. Place your ships!\n");
+    } else if (reply.status == REPLY_FULL) {
+        printf("Server has no room for a computer opponent\n");
+    } else {
+        printf("Only the creator of a waiting game can add a computer opponent\n");
+    }
+}
+
+// Ожидание изменения игры. Раз в OPPONENT_CHECK_SEC клиент проверяет,
+// что соперник еще в игре: вышедшему сервер засчитывает поражение, но
+// соперник может пропасть и незаметно для сервера (сессия истекла).
+// Возвращает false, если соперник освободил свое место или не в сети
+bool wait_opponent(Game* game, const Game* copy) {
+    struct timespec timeout = { OPPONENT_CHECK_SEC, 0 };
+    int other_idx = (my_player_num == 1) ? copy->player2_idx : copy->player1_idx;
     
-    while (current_ship_index < TOTAL_SHIPS) {
-        int ship_size = ships_to_place[current_ship_index];
+    while (__atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE) == copy->move_seq) {
+        wait_game_change(game, copy->move_seq, &timeout);
+        heartbeat();
         
-        lock();
-        Game* game = &shared->games[my_game_id];
+        Player other;
+        player_snapshot(get_player(other_idx), &other);
+        if (other.online && other.game_id == my_game_id && other.game_gen == my_game_gen) {
+            continue;
+        }
         
-        // Получаем нашу доску
-        int (*my_board)[BOARD_SIZE];
-        int* my_ships_count;
+        // Сервер освобождает места, завершая игру; копия после этого уже
+        // видит итог, и его покажет вызывающий
+        Game now;
+        if (!snapshot_my_game(&now) || now.status != copy->status) {
+            return true;
+        }
         
-        if (my_player_num == 1) {
-            my_board = game->board1;
-            my_ships_count = &game->ships_count1;
-        } else {
-            my_board = game->board2;
-            my_ships_count = &game->ships_count2;
+        printf("\nYour opponent has left the game\n");
+        return false;
+    }
+    return true;
+}
+
+// Расстановка кораблей
+void place_ships() {
+    char notice[96] = "";       // Итог прошлого ввода, показывается под доской
+    bool show_rules = true;
+    render_invalidate();
+    
+    while (1) {
+        Game game;
+        if (!snapshot_my_game(&game)) {
+            return;
+        }
+        
+        // Сколько кораблей уже расставлено, знает только сервер
+        Fleet* my_fleet = &game.fleet[my_player_num - 1];
+        current_ship_index = my_fleet->ships_count;
+        if (current_ship_index >= TOTAL_SHIPS) {
+            break;
         }
+        int ship_size = ships_to_place[current_ship_index];
         
         // Показываем текущую доску
-        printf("\nYour current board (ship size: %d):\n", ship_size);
-        print_board(my_board, 1);
+        // Правила выводятся один раз, а в режиме ANSI входят в каждый кадр,
+        // потому что первый кадр очищает экран
+        frame_reset(&frame);
+        if (show_rules) {
+            frame_printf(&frame, "\n=== PLACING SHIPS ===\n"
+                                 "You need to place 10 ships according to the rules:\n"
+                                 "• 1 battleship (4 cells)\n"
+                                 "• 2 cruisers (3 cells each)\n"
+                                 "• 3 destroyers (2 cells each)\n"
+                                 "• 4 boats (1 cell each)\n"
+                                 "Ships cannot touch each other, even diagonally!\n");
+            show_rules = render_ansi_enabled();
+        }
+        frame_printf(&frame, "\nYour current board (ship size: %d):\n", ship_size);
+        frame_boards(&frame, my_fleet, true, NULL, false);
         
-        printf("\nRemaining ships to place: ");
+        frame_printf(&frame, "\nRemaining ships to place: ");
         for (int i = current_ship_index; i < TOTAL_SHIPS; i++) {
-            printf("%d ", ships_to_place[i]);
+            frame_printf(&frame, "%d ", ships_to_place[i]);
         }
-        printf("\n");
-        
-        unlock();
+        frame_printf(&frame, "\n");
+        if (notice[0]) {
+            frame_printf(&frame, "%s\n", notice);
+            notice[0] = '\0';
+        }
+        frame_flush(&frame);
         
         // Запрашиваем координаты
         printf("Enter coordinates (x y) and direction (0-horizontal, 1-vertical): ");
         int x, y, dir_input;
         if (scanf("%d %d %d", &x, &y, &dir_input) != 3) {
-            printf("Invalid input. Please enter three numbers.\n");
+            snprintf(notice, sizeof(notice), "Invalid input. Please enter three numbers.");
             while (getchar() != '\n');  // Очищаем буфер
             continue;
         }
         getchar();  // Убираем символ новой строки
         
         if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
-            printf("Coordinates must be between 0 and %d\n", BOARD_SIZE - 1);
+            snprintf(notice, sizeof(notice), "Coordinates must be between 0 and %d", BOARD_SIZE - 1);
             continue;
         }
         
         if (dir_input != 0 && dir_input != 1) {
-            printf("Direction must be 0 (horizontal) or 1 (vertical)\n");
+            snprintf(notice, sizeof(notice), "Direction must be 0 (horizontal) or 1 (vertical)");
             continue;
         }
         
-        ShipDirection dir = (dir_input == 0) ? DIR_HORIZONTAL : DIR_VERTICAL;
-        
-        lock();
-        
-        // Проверяем возможность размещения
-        if (!can_place_ship_here(my_board, x, y, ship_size, dir)) {
-            printf("Cannot place ship here. Ships cannot touch!\n");
-            unlock();
-            continue;
+        // Проверку и размещение выполняет сервер
+        Command cmd = { .type = CMD_PLACE_SHIP, .x = x, .y = y,
+                        .dir = (dir_input == 0) ? DIR_HORIZONTAL : DIR_VERTICAL };
+        Reply reply;
+        if (send_command(&cmd, &reply) < 0) {
+            return;
         }
         
-        // Размещаем корабль
-        Ship* ship;
-        if (my_player_num == 1) {
-            ship = &game->ships1[*my_ships_count];
-        } else {
-            ship = &game->ships2[*my_ships_count];
+        if (reply.status == REPLY_CANNOT_PLACE) {
+            snprintf(notice, sizeof(notice), "Cannot place ship here. Ships cannot touch!");
+            continue;
         }
-        
-        // Занимаем клетки на доске
-        for (int i = 0; i < ship_size; i++) {
-            int cx = (dir == DIR_HORIZONTAL) ? x + i : x;
-            int cy = (dir == DIR_VERTICAL) ? y + i : y;
-            
-            my_board[cx][cy] = CELL_SHIP;
-            ship->cells[i][0] = cx;
-            ship->cells[i][1] = cy;
+        if (reply.status != REPLY_OK) {
+            printf("Ships cannot be placed now\n");
+            return;
         }
         
-        ship->size = ship_size;
-        ship->hits = 0;
-        ship->sunk = false;
-        ship->start_x = x;
-        ship->start_y = y;
-        ship->dir = dir;
-        
-        (*my_ships_count)++;
-        
-        unlock();
-        
-        printf("Ship placed successfully!\n");
-        current_ship_index++;
+        snprintf(notice, sizeof(notice), "Ship placed successfully!");
         
         // Проверяем началась ли игра
-        lock();
-        if (shared->games[my_game_id].status == GAME_PLAYING) {
+        if (reply.game_status == GAME_PLAYING) {
             printf("\n=== GAME STARTS! ===\n");
-            unlock();
             return;
         }
-        unlock();
     }
     
     printf("\nAll ships placed! Waiting for opponent...\n");
-}
-
-// Игровой ход
-void play_turn() {
-    lock();
     
-    if (my_game_id >= shared->game_count) {
-        printf("Game not found\n");
-        unlock();
-        return;
-    }
-    
-    Game* game = &shared->games[my_game_id];
-    
-    if (game->status != GAME_PLAYING) {
-        printf("Game is not active\n");
-        unlock();
-        return;
+    // Спим, пока противник не закончит расстановку
+    while (1) {
+        Game copy;
+        Game* game = snapshot_my_game(&copy);
+        if (!game) {
+            return;
+        }
+        
+        if (copy.status == GAME_PLAYING) {
+            printf("\n=== GAME STARTS! ===\n");
+            return;
+        }
+        if (copy.status != GAME_PLACING_SHIPS) {
+            return;
+        }
+        if (!wait_opponent(game, &copy)) {
+            return;
+        }
     }
-    
-    printf("\n=== Game: %s ===\n", game->name);
-    printf("Player 1: %s\n", game->player1);
-    printf("Player 2: %s\n", game->player2);
-    printf("Current turn: Player %d (%s)\n", 
-           game->current_turn,
-           game->current_turn == 1 ? game->player1 : game->player2);
-    
-    // Показываем наше поле
-    printf("\nYour ships:\n");
-    print_board(my_player_num == 1 ? game->board1 : game->board2, 1);
-    
-    // Показываем поле противника
-    printf("\nOpponent's field (your shots):\n");
-    print_board(my_player_num == 1 ? game->board2 : game->board1, 0);
-    
-    if (game->current_turn == my_player_num) {
-        unlock();
+}
+
+// Ввод координат выстрела и отправка серверу.
+// Возвращает 1, если игра закончилась нашей победой, -1 при ошибке
+int fire_shot() {
+    while (1) {
+        printf("Enter coordinates to shoot (x y): ");
+        int x, y;
+        if (scanf("%d %d", &x, &y) != 2) {
+            printf("Invalid input. Please enter two numbers.\n");
+            while (getchar() != '\n');
+            continue;
+        }
+        getchar();
         
-        printf("\n=== YOUR TURN! ===\n");
+        if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
+            printf("Coordinates must be between 0 and %d\n", BOARD_SIZE - 1);
+            continue;
+        }
         
-        while (1) {
-            printf("Enter coordinates to shoot (x y): ");
-            int x, y;
-            if (scanf("%d %d", &x, &y) != 2) {
-                printf("Invalid input. Please enter two numbers.\n");
-                while (getchar() != '\n');
-                continue;
+        // Выстрел обрабатывает сервер
+        Command cmd = { .type = CMD_SHOT, .x = x, .y = y };
+        Reply reply;
+        if (send_command(&cmd, &reply) < 0) {
+            return -1;
+        }
+        
+        // Проверяем не стреляли ли уже сюда
+        if (reply.status == REPLY_ALREADY_SHOT) {
+            printf("You already shot here! Try different coordinates.\n");
+            continue;
+        }
+        if (reply.status != REPLY_OK) {
+            printf("Shot rejected by server\n");
+            return -1;
+        }
+        
+        if (reply.shot_result > 0) {
+            printf("HIT!\n");
+            if (reply.shot_result == 2) {
+                printf("SHIP SUNK!\n");
             }
-            getchar();
             
-            if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
-                printf("Coordinates must be between 0 and %d\n", BOARD_SIZE - 1);
-                continue;
+            if (reply.game_status == GAME_FINISHED && reply.winner == my_player_num) {
+                printf("\n=== VICTORY! You destroyed all enemy ships! ===\n");
+                return 1;
             }
-            
-            lock();
-            
-            // Определяем доску цели
-            int (*target_board)[BOARD_SIZE];
-            Ship* target_ships;
-            int* target_ships_count;
-            
-            if (my_player_num == 1) {
-                target_board = game->board2;
-                target_ships = game->ships2;
-                target_ships_count = &game->ships_count2;
+            printf("You get another turn!\n");
+        } else {
+            printf("MISS!\n");
+            printf("Turn passes to opponent\n");
+        }
+        return 0;
+    }
+}
+
+// Игра до конца партии. Пока ходит противник, клиент спит на move_seq
+// и перерисовывает доски сразу после его выстрела
+void play_turn() {
+    render_invalidate();
+    
+    while (1) {
+        // Копия содержит и номер изменения, которое сейчас будет нарисовано
+        Game copy;
+        Game* game = snapshot_my_game(&copy);
+        if (!game) {
+            printf("Game not found\n");
+            return;
+        }
+        
+        if (copy.status == GAME_FINISHED) {
+            if (copy.winner == my_player_num) {
+                printf("\n=== VICTORY! Your opponent has left the game ===\n");
+            } else if (copy.winner != 0) {
+                printf("\n=== DEFEAT! %s destroyed all your ships ===\n",
+                       copy.winner == 1 ? copy.player1 : copy.player2);
             } else {
-                target_board = game->board1;
-                target_ships = game->ships1;
-                target_ships_count = &game->ships_count1;
-            }
-            
-            // Проверяем не стреляли ли уже сюда
-            if (target_board[x][y] == CELL_HIT || 
-                target_board[x][y] == CELL_MISS || 
-                target_board[x][y] == CELL_SUNK) {
-                printf("You already shot here! Try different coordinates.\n");
-                unlock();
-                continue;
+                printf("\nThe game has been closed\n");
             }
-            
-            // Выстрел
-            if (target_board[x][y] == CELL_SHIP) {
-                printf("HIT!\n");
-                target_board[x][y] = CELL_HIT;
-                
-                // Ищем корабль и увеличиваем счетчик попаданий
-                for (int s = 0; s < *target_ships_count; s++) {
-                    for (int c = 0; c < target_ships[s].size; c++) {
-                        if (target_ships[s].cells[c][0] == x && 
-                            target_ships[s].cells[c][1] == y) {
-                            target_ships[s].hits++;
-                            
-                            // Проверяем потопление
-                            if (target_ships[s].hits == target_ships[s].size) {
-                                target_ships[s].sunk = true;
-                                
-                                // Помечаем все клетки корабля как потопленные
-                                for (int i = 0; i < target_ships[s].size; i++) {
-                                    int cx = target_ships[s].cells[i][0];
-                                    int cy = target_ships[s].cells[i][1];
-                                    target_board[cx][cy] = CELL_SUNK;
-                                }
-                                
-                                printf("SHIP SUNK!\n");
-                            }
-                            break;
-                        }
-                    }
-                }
-                
-                // Проверяем победу
-                int ships_left = 0;
-                for (int s = 0; s < *target_ships_count; s++) {
-                    if (!target_ships[s].sunk) {
-                        ships_left = 1;
-                        break;
-                    }
-                }
-                
-                if (ships_left == 0) {
-                    printf("\n=== VICTORY! You destroyed all enemy ships! ===\n");
-                    
-                    game->status = GAME_FINISHED;
-                    game->winner = my_player_num;
-                    
-                    // Обновляем статистику
-                    for (int i = 0; i < shared->player_count; i++) {
-                        if (strcmp(shared->players[i].login, my_login) == 0) {
-                            shared->players[i].wins++;
-                        }
-                        if (strcmp(shared->players[i].login, 
-                                   my_player_num == 1 ? game->player2 : game->player1) == 0) {
-                            shared->players[i].losses++;
-                        }
-                    }
-                    
-                    // Освобождаем игроков
-                    for (int i = 0; i < shared->player_count; i++) {
-                        if (strcmp(shared->players[i].login, my_login) == 0 ||
-                            strcmp(shared->players[i].login, 
-                                   my_player_num == 1 ? game->player2 : game->player1) == 0) {
-                            shared->players[i].game_id = -1;
-                        }
-                    }
-                    
+            my_game_id = -1;
+            my_player_num = 0;
+            return;
+        }
+        
+        if (copy.status != GAME_PLAYING) {
+            printf("Game is not active\n");
+            return;
+        }
+        
+        // Кадр собирается из копии игры и выводится одним write
+        frame_reset(&frame);
+        frame_printf(&frame, "\n=== Game: %s ===\n", copy.name);
+        frame_printf(&frame, "Player 1: %s\n", copy.player1);
+        frame_printf(&frame, "Player 2: %s\n", copy.player2);
+        frame_printf(&frame, "Current turn: Player %d (%s)\n",
+                     copy.current_turn,
+                     copy.current_turn == 1 ? copy.player1 : copy.player2);
+        
+        // Слева наше поле, справа поле противника
+        frame_printf(&frame, "\n%-*s%s\n", FRAME_BOARD_WIDTH + FRAME_BOARD_GAP,
+                     "Your ships:", "Opponent's field (your shots):");
+        frame_boards(&frame, &copy.fleet[my_player_num - 1], true,
+                     &copy.fleet[2 - my_player_num], false);
+        frame_flush(&frame);
+        
+        int my_turn = copy.current_turn == my_player_num;
+        
+        if (my_turn) {
+            printf("\n=== YOUR TURN! ===\n");
+            int result = fire_shot();
+            if (result != 0) {
+                if (result > 0) {
                     my_game_id = -1;
                     my_player_num = 0;
-                } else {
-                    printf("You get another turn!\n");
                 }
-            } else {
-                printf("MISS!\n");
-                target_board[x][y] = CELL_MISS;
-                game->current_turn = (my_player_num == 1) ? 2 : 1;
-                printf("Turn passes to opponent\n");
+                return;
+            }
+        } else {
+            printf("\nWaiting for opponent's move...\n");
+            fflush(stdout);
+            if (!wait_opponent(game, &copy)) {
+                return;
             }
-            
-            game->last_move = time(NULL);
-            unlock();
-            break;
         }
-    } else {
-        unlock();
-        printf("\nWaiting for opponent's move...\n");
-        printf("Press Enter to refresh");
-        getchar();
     }
 }
 
 // Просмотр списка игр
 void list_games() {
-    lock();
-    
     printf("\n=== Games List ===\n");
     
-    if (shared->game_count == 0) {
-        printf("No active games\n");
-    } else {
-        for (int i = 0; i < shared->game_count; i++) {
-            Game* game = &shared->games[i];
+    int total = 0;
+    for (int s = 0; s < shard_total; s++) {
+        ShmArena view = { 0 };
+        ShmArena* games = open_shard_view(s, &view);
+        if (!games) {
+            continue;
+        }
+        int* ids = malloc(arena_game_limit(games->shared) * sizeof(int));
+        int live = arena_live_games(games, ids);
+        total += live;
+        for (int n = 0; n < live; n++) {
+            int i = ids[n];
+            Game game;
             const char* status;
             
-            switch (game->status) {
+            game_snapshot(arena_game(games, i), &game);
+            if (!game.in_use) {
+                continue;
+            }
+            
+            switch (game.status) {
                 case GAME_WAITING:
                     status = "waiting for player 2";
                     break;
@@ -663,38 +865,157 @@ void list_games() {
             }
             
             printf("%d. '%s' - %s vs %s - %s\n",
-                   i, game->name, game->player1,
-                   strlen(game->player2) > 0 ? game->player2 : "waiting",
+                   SHARD_GAME_ID(i, s, shard_total), game.name, game.player1,
+                   strlen(game.player2) > 0 ? game.player2 : "waiting",
                    status);
         }
+        free(ids);
+        close_shard_view(&view, games);
+    }
+    if (total == 0) {
+        printf("No active games\n");
     }
-    
-    unlock();
 }
 
 // Просмотр статистики
 void show_stats() {
-    lock();
-    
-    for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, my_login) == 0) {
-            printf("\n=== Your Statistics ===\n");
-            printf("Player: %s\n", shared->players[i].login);
-            printf("Wins: %d\n", shared->players[i].wins);
-            printf("Losses: %d\n", shared->players[i].losses);
-            printf("Total games: %d\n", 
-                   shared->players[i].wins + shared->players[i].losses);
-            
-            if (shared->players[i].wins + shared->players[i].losses > 0) {
-                float win_rate = (float)shared->players[i].wins / 
-                                (shared->players[i].wins + shared->players[i].losses) * 100;
-                printf("Win rate: %.1f%%\n", win_rate);
+    Player stats;
+    total_stats(&stats);
+    
+    printf("\n=== Your Statistics ===\n");
+    printf("Player: %s\n", stats.login);
+    printf("Wins: %d\n", stats.wins);
+    printf("Losses: %d\n", stats.losses);
+    printf("Total games: %d\n", stats.wins + stats.losses);
+    
+    if (stats.wins + stats.losses > 0) {
+        float win_rate = (float)stats.wins / (stats.wins + stats.losses) * 100;
+        printf("Win rate: %.1f%%\n", win_rate);
+    }
+}
+
+// Строка хода для зрителя и повтора
+void print_move(const char* player1, const char* player2, const GameMove* move) {
+    static const char* results[] = { "miss", "hit", "ship sunk" };
+    printf("%s -> (%d, %d): %s\n", move->player == 1 ? player1 : player2,
+           move->x, move->y, move->result <= 2 ? results[move->result] : "?");
+}
+
+// Обе доски кадром для зрителя и повтора
+void print_fleets(const char* player1, const Fleet* fleet1,
+                  const char* player2, const Fleet* fleet2, bool show_ships) {
+    char title[MAX_LOGIN + 16];
+    snprintf(title, sizeof(title), "%s's fleet:", player1);
+    
+    frame_reset(&frame);
+    frame_printf(&frame, "\n%-*s%s's fleet:\n", FRAME_BOARD_WIDTH + FRAME_BOARD_GAP, title, player2);
+    frame_boards(&frame, fleet1, show_ships, fleet2, show_ships);
+    frame_flush(&frame);
+}
+
+// Режим зрителя: сегмент отображен только для чтения, канал и логин не
+// нужны. Ходы берутся из журнала игры, поэтому игроки зрителя не замечают
+int watch_game(int id) {
+    if (id < 0 || id >= get_game_count()) {
+        printf("Game not found\n");
+        return 1;
+    }
+    
+    Game* game = get_game(id);
+    Game copy;
+    game_snapshot(game, &copy);
+    if (!copy.in_use) {
+        printf("Game not found\n");
+        return 1;
+    }
+    
+    uint32_t generation = copy.generation;
+    uint32_t cursor = 0;
+    GameMove moves[MOVE_LOG_SIZE];
+    struct timespec poll = { 0, SPECTATE_POLL_MS * 1000000L };
+    
+    printf("=== Watching '%s': %s vs %s ===\n", copy.name, copy.player1,
+           copy.player2[0] ? copy.player2 : "waiting");
+    
+    while (1) {
+        // Номер изменения читаем до журнала, чтобы не проспать новый ход
+        uint32_t seen = __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE);
+        int count = movelog_read(game, &cursor, moves, MOVE_LOG_SIZE);
+        
+        game_snapshot(game, &copy);
+        if (!copy.in_use || copy.generation != generation) {
+            printf("Game has been closed by the server\n");
+            return 0;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            print_move(copy.player1, copy.player2, &moves[i]);
+        }
+        
+        bool finished = copy.status == GAME_FINISHED && cursor == copy.move_count;
+        if (finished || count > 0) {
+            print_fleets(copy.player1, &copy.fleet[0], copy.player2, &copy.fleet[1], finished);
+        }
+        if (finished) {
+            if (copy.winner != 0) {
+                printf("\n=== Winner: %s ===\n", copy.winner == 1 ? copy.player1 : copy.player2);
+            } else {
+                printf("\n=== Game abandoned ===\n");
             }
-            break;
+            return 0;
+        }
+        fflush(stdout);
+        
+        // Журнал игры переходит в снимок целиком: продолжаем с того же хода
+        if (server_retired(shared)) {
+            reattach(PROT_READ);
+            game = get_game(id);
+            continue;
         }
+        
+        // Зритель не может отметиться в watchers (сегмент только для чтения).
+        // Пока кто-то из игроков ждет хода, сервер будит и зрителя;
+        // иначе зритель просыпается по таймауту
+        futex_wait(&game->move_seq, seen, &poll);
     }
+}
+
+// Проигрывание файла повтора: доски восстанавливаются по маскам
+// кораблей, затем на них по порядку применяются записанные выстрелы
+int show_replay(const char* path) {
+    ReplayHeader header;
+    GameMove moves[MOVE_LOG_SIZE];
     
-    unlock();
+    int ret = replay_load(path, &header, moves);
+    if (ret < 0) {
+        printf(ret == -1 ? "Cannot open replay file %s\n" : "%s is not a valid replay file\n", path);
+        return 1;
+    }
+    
+    Fleet fleet[2];
+    memset(fleet, 0, sizeof(fleet));
+    for (int p = 0; p < 2; p++) {
+        for (uint32_t i = 0; i < header.ships_count[p]; i++) {
+            fleet_add_ship(&fleet[p], header.ship_mask[p][i]);
+        }
+    }
+    
+    time_t finished = header.finished_at;
+    printf("=== Replay: '%s' - %s vs %s ===\n", header.name, header.player1, header.player2);
+    printf("Finished: %s", ctime(&finished));
+    
+    for (uint32_t i = 0; i < header.move_count; i++) {
+        GameMove* move = &moves[i];
+        printf("%3u. ", i + 1);
+        print_move(header.player1, header.player2, move);
+        if (move->player == 1 || move->player == 2) {
+            fleet_shot(&fleet[2 - move->player], move->x, move->y);
+        }
+    }
+    
+    print_fleets(header.player1, &fleet[0], header.player2, &fleet[1], true);
+    printf("\n=== Winner: %s ===\n", header.winner == 1 ? header.player1 : header.player2);
+    return 0;
 }
 
 // Главное меню (без изменений, как в оригинале)
@@ -705,46 +1026,50 @@ void main_menu() {
         printf("\n=== Sea Battle ===\n");
         printf("Player: %s\n", my_login);
         
-        if (my_game_id >= 0) {
-            lock();
-            Game* game = &shared->games[my_game_id];
-            
-            printf("Game: '%s' (Player %d)\n", game->name, my_player_num);
+        Game game;
+        if (snapshot_my_game(&game)) {
+            printf("Game: '%s' (Player %d)\n", game.name, my_player_num);
             printf("Status: ");
             
-            switch (game->status) {
+            switch (game.status) {
                 case GAME_WAITING:
                     printf("Waiting for opponent\n");
                     break;
                 case GAME_PLACING_SHIPS:
                     printf("Placing ships (%d/10 placed)\n", 
-                           my_player_num == 1 ? game->ships_count1 : game->ships_count2);
+                           game.fleet[my_player_num - 1].ships_count);
                     break;
                 case GAME_PLAYING:
                     printf("Playing - %s's turn\n", 
-                           game->current_turn == 1 ? game->player1 : game->player2);
+                           game.current_turn == 1 ? game.player1 : game.player2);
                     break;
                 case GAME_FINISHED:
-                    printf("Finished - Winner: %s\n", 
-                           game->winner == 1 ? game->player1 : game->player2);
+                    if (game.winner != 0) {
+                        printf("Finished - Winner: %s\n", 
+                               game.winner == 1 ? game.player1 : game.player2);
+                    } else {
+                        printf("Finished - abandoned\n");
+                    }
                     break;
             }
             
-            unlock();
-            
             if (my_game_id >= 0) {
                 printf("\n1. Play/Continue\n");
                 printf("2. View game info\n");
                 printf("3. Leave game\n");
                 printf("4. Exit\n");
+                if (game.status == GAME_WAITING) {
+                    printf("5. Play against computer\n");
+                }
             }
         } else {
             printf("Status: Not in game\n");
             printf("\n1. Create new game\n");
-            printf("2. Join existing game\n");
-            printf("3. List all games\n");
-            printf("4. Show statistics\n");
-            printf("5. Exit\n");
+            printf("2. Find opponent\n");
+            printf("3. Join game by ID\n");
+            printf("4. List all games\n");
+            printf("5. Show statistics\n");
+            printf("6. Exit\n");
         }
         
         printf("\nChoice: ");
@@ -757,9 +1082,11 @@ void main_menu() {
         getchar();
         
         if (my_game_id >= 0) {
-            lock();
-            int game_status = shared->games[my_game_id].status;
-            unlock();
+            int game_status = GAME_FINISHED;
+            Game game;
+            if (snapshot_my_game(&game)) {
+                game_status = game.status;
+            }
             
             switch (choice) {
                 case 1:
@@ -778,14 +1105,11 @@ void main_menu() {
                     
                 case 3:
                     // Покидаем игру
-                    lock();
-                    for (int i = 0; i < shared->player_count; i++) {
-                        if (strcmp(shared->players[i].login, my_login) == 0) {
-                            shared->players[i].game_id = -1;
-                            break;
-                        }
+                    {
+                        Command cmd = { .type = CMD_LEAVE_GAME };
+                        Reply reply;
+                        send_command(&cmd, &reply);
                     }
-                    unlock();
                     
                     my_game_id = -1;
                     my_player_num = 0;
@@ -795,6 +1119,10 @@ void main_menu() {
                 case 4:
                     return;
                     
+                case 5:
+                    add_bot();
+                    break;
+                    
                 default:
                     printf("Invalid choice\n");
             }
@@ -805,18 +1133,22 @@ void main_menu() {
                     break;
                     
                 case 2:
-                    join_game();
+                    find_opponent();
                     break;
                     
                 case 3:
-                    list_games();
+                    join_game();
                     break;
                     
                 case 4:
-                    show_stats();
+                    list_games();
                     break;
                     
                 case 5:
+                    show_stats();
+                    break;
+                    
+                case 6:
                     return;
                     
                 default:
@@ -824,20 +1156,39 @@ void main_menu() {
             }
         }
         
-        // Обновляем время последней активности
-        lock();
-        for (int i = 0; i < shared->player_count; i++) {
-            if (strcmp(shared->players[i].login, my_login) == 0) {
-                shared->players[i].last_seen = time(NULL);
-                break;
-            }
-        }
-        unlock();
+        heartbeat();
     }
 }
 
 // Основная функция клиента
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--replay") == 0) {
+        return show_replay(argv[2]);
+    }
+    
+    if (argc == 3 && strcmp(argv[1], "--watch") == 0) {
+        // Глобальный id игры: шард и id слота на нем
+        int id = atoi(argv[2]);
+        shard_total = shard_count_lookup();
+        if (connect_to_server(id < 0 ? 0 : id % shard_total, PROT_READ) < 0) {
+            return 1;
+        }
+        int ret = watch_game(id < 0 ? id : id / shard_total);
+        arena_detach(&arena);
+        close(mmap_fd);
+        return ret;
+    }
+    
+    // Перерисовка только изменившихся строк имеет смысл лишь на терминале
+    if (argc == 2 && strcmp(argv[1], "--ansi") == 0) {
+        render_set_ansi(isatty(STDOUT_FILENO));
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--ansi]\n"
+                        "       %s --watch GAME_ID\n"
+                        "       %s --replay FILE\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    
     printf("=== Sea Battle Client ===\n");
     printf("Using MMAP for communication with server\n");
     printf("Synchronization: POSIX mutexes\n\n");
@@ -853,24 +1204,8 @@ int main() {
     // Выход
     printf("\nGoodbye, %s!\n", my_login);
     
-    // Помечаем игрока как оффлайн
-    lock();
-    for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, my_login) == 0) {
-            shared->players[i].online = false;
-            break;
-        }
-    }
-    unlock();
-    
-    // Очистка ресурсов
-    if (shared) {
-        munmap(shared, MMAP_SIZE);
-    }
-    
-    if (mmap_fd >= 0) {
-        close(mmap_fd);
-    }
+    // Помечаем игрока как оффлайн, освобождаем канал и сегмент
+    leave_shard();
     
     return 0;
 }
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "render.h"
+#include "../shared/board.h"
+
+// Предыдущий выведенный кадр - по нему ищутся изменившиеся строки
+static Frame prev;
+static bool prev_valid = false;
+static bool ansi = false;
+
+// Буфер вывода ANSI: кадр плюс управляющие последовательности на строку
+static char out[2 * FRAME_SIZE];
+
+static const char cell_symbols[] = {
+    [CELL_EMPTY] = '.',
+    [CELL_SHIP] = 'S',
+    [CELL_HIT] = 'X',
+    [CELL_MISS] = 'O',
+    [CELL_SUNK] = '#',
+};
+
+void frame_reset(Frame* frame) {
+    frame->len = 0;
+}
+
+void frame_printf(Frame* frame, const char* fmt, ...) {
+    size_t room = FRAME_SIZE - frame->len;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(frame->data + frame->len, room, fmt, args);
+    va_end(args);
+    
+    if (n > 0) {
+        frame->len += (size_t)n < room ? (size_t)n : room - 1;
+    }
+}
+
+// Строка доски шириной FRAME_BOARD_WIDTH: номер строки и клетки
+static char* put_row(char* p, const Fleet* fleet, bool show_ships, int y) {
+    *p++ = ' ';
+    *p++ = '0' + y;
+    *p++ = ' ';
+    for (int x = 0; x < BOARD_SIZE; x++) {
+        CellType cell = fleet_cell(fleet, x, y);
+        if (cell == CELL_SHIP && !show_ships) {
+            cell = CELL_EMPTY;
+        }
+        *p++ = ' ';
+        *p++ = cell_symbols[cell];
+        *p++ = ' ';
+    }
+    return p;
+}
+
+static char* put_header(char* p) {
+    memset(p, ' ', 3);
+    p += 3;
+    for (int x = 0; x < BOARD_SIZE; x++) {
+        *p++ = ' ';
+        *p++ = '0' + x;
+        *p++ = ' ';
+    }
+    return p;
+}
+
+static char* put_gap(char* p) {
+    memset(p, ' ', FRAME_BOARD_GAP);
+    return p + FRAME_BOARD_GAP;
+}
+
+void frame_boards(Frame* frame, const Fleet* left, bool left_ships,
+                  const Fleet* right, bool right_ships) {
+    size_t line = 2 * FRAME_BOARD_WIDTH + FRAME_BOARD_GAP + 1;
+    if (FRAME_SIZE - frame->len <= (BOARD_SIZE + 1) * line) {
+        return;
+    }
+    
+    // Клетки пишутся прямо в кадр, без форматирования printf
+    char* p = frame->data + frame->len;
+    p = put_header(p);
+    if (right) {
+        p = put_header(put_gap(p));
+    }
+    *p++ = '\n';
+    
+    for (int y = 0; y < BOARD_SIZE; y++) {
+        p = put_row(p, left, left_ships, y);
+        if (right) {
+            p = put_row(put_gap(p), right, right_ships, y);
+        }
+        *p++ = '\n';
+    }
+    frame->len = p - frame->data;
+}
+
+static int write_all(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, size);
+        if (n < 0) {
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Длина строки, начинающейся с data (без '\n')
+static size_t line_length(const char* data, size_t left) {
+    const char* end = memchr(data, '\n', left);
+    return end ? (size_t)(end - data) : left;
+}
+
+// Только строки, отличающиеся от строк предыдущего кадра на тех же местах
+static size_t diff_frame(const Frame* frame) {
+    size_t len = 0;
+    size_t pos = 0, prev_pos = 0;
+    int row = 1;
+    
+    while (pos < frame->len) {
+        size_t n = line_length(frame->data + pos, frame->len - pos);
+        size_t prev_n = prev_pos < prev.len ? line_length(prev.data + prev_pos, prev.len - prev_pos) : 0;
+        bool same = prev_pos < prev.len && n == prev_n &&
+                    memcmp(frame->data + pos, prev.data + prev_pos, n) == 0;
+        
+        if (!same && len + n + 32 < sizeof(out)) {
+            len += snprintf(out + len, sizeof(out) - len, "\033[%d;1H", row);
+            memcpy(out + len, frame->data + pos, n);
+            len += n;
+            len += snprintf(out + len, sizeof(out) - len, "\033[K");
+        }
+        
+        pos += n + 1;
+        prev_pos = prev_pos < prev.len ? prev_pos + prev_n + 1 : prev_pos;
+        row++;
+    }
+    
+    // Курсор под кадр, старый хвост экрана стираем
+    len += snprintf(out + len, sizeof(out) - len, "\033[%d;1H\033[J", row);
+    return len;
+}
+
+void frame_flush(Frame* frame) {
+    // Текст, напечатанный через stdio до кадра, должен выйти раньше него
+    fflush(stdout);
+    
+    if (!ansi) {
+        write_all(frame->data, frame->len);
+        return;
+    }
+    
+    size_t len;
+    if (prev_valid) {
+        len = diff_frame(frame);
+    } else {
+        len = snprintf(out, sizeof(out), "\033[H\033[2J");
+        memcpy(out + len, frame->data, frame->len);
+        len += frame->len;
+    }
+    write_all(out, len);
+    
+    memcpy(prev.data, frame->data, frame->len);
+    prev.len = frame->len;
+    prev_valid = true;
+}
+
+void render_set_ansi(bool enabled) {
+    ansi = enabled;
+    prev_valid = false;
+}
+
+bool render_ansi_enabled() {
+    return ansi;
+}
+
+void render_invalidate() {
+    prev_valid = false;
+}
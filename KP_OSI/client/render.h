@@ -0,0 +1,42 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "../shared/protocol.h"
+
+// Кадр: весь текст экрана собирается в заранее выделенный буфер
+// и выводится одним write
+#define FRAME_SIZE 4096
+
+// Ширина доски в символах и промежуток между досками в кадре
+#define FRAME_BOARD_WIDTH (3 + 3 * BOARD_SIZE)
+#define FRAME_BOARD_GAP 4
+
+typedef struct {
+    char data[FRAME_SIZE];
+    size_t len;
+} Frame;
+
+void frame_reset(Frame* frame);
+
+// Дописывание текста (не поместившийся хвост отбрасывается)
+void frame_printf(Frame* frame, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Доски бок о бок с общей строкой номеров столбцов. right может быть NULL.
+// show_ships - показывать ли целые корабли доски
+void frame_boards(Frame* frame, const Fleet* left, bool left_ships,
+                  const Fleet* right, bool right_ships);
+
+// Вывод кадра (предварительно сбрасывается буфер stdio).
+// В режиме ANSI кадр рисуется с верхнего левого угла экрана, а следующий
+// кадр перерисовывает только изменившиеся строки и стирает все под собой
+void frame_flush(Frame* frame);
+
+void render_set_ansi(bool enabled);
+bool render_ansi_enabled();
+
+// Экран изменен в обход кадров: следующий кадр рисуется целиком
+void render_invalidate();
+
+#endif // RENDER_H
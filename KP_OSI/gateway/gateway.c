@@ -0,0 +1,857 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../shared/protocol.h"
+#include "../shared/arena.h"
+#include "../shared/channel.h"
+#include "../shared/events.h"
+#include "../shared/seqlock.h"
+#include "../shared/shard.h"
+#include "../shared/wire.h"
+
+// Шлюз: принимает клиентов по TCP и Unix-сокетам и переводит их запросы
+// в команды каналов shared memory. Все сокеты обслуживает один поток
+// через epoll. Команды, пришедшие за итерацию цикла, будят сервер одним
+// wake_server, а сервер сообщает об ответах одним увеличением change_seq
+// за свою итерацию и битами каналов в карте ready_off. Второй поток только
+// ждет на change_seq и переводит пробуждение в eventfd, который слушает epoll
+
+#define MAX_EVENTS 512
+
+// Исходящий буфер соединения. Каждый запрос получает ровно один ответ,
+// и место под ответы уже принятых запросов зарезервировано заранее
+#define REPLY_MSG (sizeof(WireHeader) + sizeof(WireReply))
+#define GAME_MSG (sizeof(WireHeader) + sizeof(WireGame))
+#define CONN_OUT_SIZE 2048
+
+// Списки соединений, которые цикл обходит целиком
+typedef enum {
+    LIST_OPEN,              // Все соединения
+    LIST_CLOSING,           // Сокет закрыт, канал еще не освобожден
+    LIST_WAITING,           // Ждет изменения игры (WIRE_WAIT_GAME)
+    LIST_DIRTY,             // Изменилось в этой итерации: разобрать вход, отправить выход
+    LIST_COUNT
+} ConnListId;
+
+typedef struct {
+    int fd;                 // -1 после закрытия сокета
+    int channel;            // -1, пока соединение не прислало команду
+    uint32_t inflight;      // Команд в кольце канала без ответа
+    uint32_t events;        // Маска, зарегистрированная в epoll
+    bool logout_sent;
+    int pos[LIST_COUNT];    // Позиция в каждом списке (-1 - не в списке)
+    int wait_game;
+    uint32_t wait_seq;
+    uint32_t wait_tag;
+    size_t in_len;
+    size_t out_len;
+    char in[sizeof(WireHeader) + WIRE_MAX_BODY];
+    char out[CONN_OUT_SIZE];
+} Conn;
+
+typedef struct {
+    Conn** items;
+    int count;
+    int cap;
+} ConnList;
+
+ShmArena arena;
+SharedData* shared = NULL;
+int mmap_fd = -1;
+volatile sig_atomic_t running = 1;
+
+int epoll_fd = -1;
+int bell_fd = -1;               // eventfd: сервер закончил итерацию
+int tcp_fd = -1;
+int unix_fd = -1;
+ConnList lists[LIST_COUNT];
+int submitted = 0;              // Команд отправлено за итерацию
+
+// Соединение по номеру канала и битовая карта каналов этого шлюза
+// (в ready_off есть биты и других шлюзов)
+Conn** channel_conns = NULL;
+uint64_t* own_channels = NULL;
+
+// Настройки (аргументы командной строки)
+const char* bind_addr = "127.0.0.1";
+int tcp_port = GATEWAY_PORT;    // 0 - без TCP
+const char* unix_path = GATEWAY_SOCKET;
+int shard_index = 0;            // Шард, к которому подключен шлюз
+
+void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Без SA_RESTART, чтобы сигнал прерывал epoll_wait
+void setup_signals() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+int parse_config(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            char* end;
+            long port = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || port < 0 || port > 65535) {
+                fprintf(stderr, "Port must be a number from 0 to 65535\n");
+                return -1;
+            }
+            tcp_port = (int)port;
+        } else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            bind_addr = argv[++i];
+        } else if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-unix") == 0) {
+            unix_path = NULL;
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            char* end;
+            long shard = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || shard < 0 || shard >= MAX_SHARDS) {
+                fprintf(stderr, "Shard must be a number from 0 to %d\n", MAX_SHARDS - 1);
+                return -1;
+            }
+            shard_index = (int)shard;
+        } else {
+            fprintf(stderr, "Usage: %s [--port N] [--bind ADDR] [--unix PATH | --no-unix] [--shard K]\n", argv[0]);
+            return -1;
+        }
+    }
+    
+    if (tcp_port == 0 && !unix_path) {
+        fprintf(stderr, "Nothing to listen on\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Шлюз обслуживает один шард; для нескольких шардов запускается
+// по шлюзу на каждый (со своими --port и --unix)
+int connect_to_server() {
+    int shard_count = shard_count_lookup();
+    if (shard_index >= shard_count) {
+        fprintf(stderr, "There are only %d shards\n", shard_count);
+        return -1;
+    }
+    mmap_fd = shard_open(shard_index, shard_count, O_RDWR);
+    if (mmap_fd < 0) {
+        fprintf(stderr, "Server is not running\n");
+        return -1;
+    }
+    
+    if (arena_attach(&arena, mmap_fd, PROT_READ | PROT_WRITE) < 0) {
+        fprintf(stderr, "Shared memory not properly initialized by server\n");
+        close(mmap_fd);
+        return -1;
+    }
+    shared = arena.shared;
+    return 0;
+}
+
+// Мягкий предел открытых файлов поднимается до жесткого:
+// на каждое соединение уходит дескриптор
+void raise_fd_limit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        printf("Connection limit: %llu file descriptors\n", (unsigned long long)limit.rlim_cur);
+    }
+}
+
+// ===== Списки соединений =====
+
+void list_add(ConnListId id, Conn* c) {
+    ConnList* list = &lists[id];
+    if (c->pos[id] >= 0) {
+        return;
+    }
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : 256;
+        Conn** items = realloc(list->items, cap * sizeof(Conn*));
+        if (!items) {
+            perror("realloc failed");
+            exit(1);
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    c->pos[id] = list->count;
+    list->items[list->count++] = c;
+}
+
+// Удаление с переносом последнего элемента на освободившееся место.
+// При обходе списка с конца удалять можно текущий элемент
+void list_remove(ConnListId id, Conn* c) {
+    ConnList* list = &lists[id];
+    int pos = c->pos[id];
+    if (pos < 0) {
+        return;
+    }
+    Conn* last = list->items[--list->count];
+    list->items[pos] = last;
+    last->pos[id] = pos;
+    c->pos[id] = -1;
+}
+
+// ===== Соединения =====
+
+void conn_close(Conn* c);
+
+// Сообщение в исходящий буфер (отправляется в конце итерации)
+void conn_send(Conn* c, uint8_t type, uint32_t tag, const void* body, size_t len) {
+    if (c->fd < 0) {
+        return;
+    }
+    WireHeader header = { .length = len, .type = type, .tag = tag };
+    if (c->out_len + sizeof(header) + len > CONN_OUT_SIZE) {
+        conn_close(c);
+        return;
+    }
+    memcpy(c->out + c->out_len, &header, sizeof(header));
+    memcpy(c->out + c->out_len + sizeof(header), body, len);
+    c->out_len += sizeof(header) + len;
+    list_add(LIST_DIRTY, c);
+}
+
+void send_error(Conn* c, uint32_t tag, WireErrorCode code) {
+    WireError error = { .code = code };
+    conn_send(c, WIRE_ERROR, tag, &error, sizeof(error));
+}
+
+// Хватит ли места в исходящем буфере на ответ еще одного запроса
+bool conn_has_room(const Conn* c) {
+    size_t reserved = c->out_len + c->inflight * REPLY_MSG;
+    if (c->pos[LIST_WAITING] >= 0) {
+        reserved += GAME_MSG;
+    }
+    return reserved + GAME_MSG <= CONN_OUT_SIZE;
+}
+
+// Команда в кольцо канала. Сервер будится один раз в конце итерации
+void conn_submit(Conn* c, const Command* cmd) {
+    Channel* ch = arena_channel(shared, c->channel);
+    uint32_t tail = ch->cmd_tail;
+    ch->commands[tail % CHANNEL_RING_SIZE] = *cmd;
+    __atomic_store_n(&ch->cmd_tail, tail + 1, __ATOMIC_RELEASE);
+    mark_channel(shared, c->channel);
+    
+    c->inflight++;
+    submitted++;
+}
+
+void send_game_state(Conn* c, uint32_t tag, int game_id) {
+    static Game copy;
+    Game* game = arena_game(&arena, game_id);
+    
+    // move_seq читается до снимка: изменение после снимка разбудит
+    // следующий WIRE_WAIT_GAME
+    uint32_t seq = __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE);
+    game_snapshot(game, &copy);
+    
+    WireGame state;
+    memset(&state, 0, sizeof(state));
+    state.game_id = game_id;
+    state.generation = copy.generation;
+    state.move_seq = seq;
+    state.in_use = copy.in_use;
+    state.status = copy.status;
+    state.current_turn = copy.current_turn;
+    state.winner = copy.winner;
+    memcpy(state.name, copy.name, MAX_NAME);
+    memcpy(state.player1, copy.player1, MAX_LOGIN);
+    memcpy(state.player2, copy.player2, MAX_LOGIN);
+    
+    if (c->channel >= 0) {
+        int idx = __atomic_load_n(&arena_channel(shared, c->channel)->player_idx, __ATOMIC_ACQUIRE);
+        if (idx >= 0 && idx == copy.player1_idx) {
+            state.player_num = 1;
+        } else if (idx >= 0 && idx == copy.player2_idx) {
+            state.player_num = 2;
+        }
+    }
+    if (state.player_num) {
+        state.own_ships = copy.fleet[state.player_num - 1].ships;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        state.ships_left[i] = copy.fleet[i].ships_left;
+        state.hits[i] = copy.fleet[i].hits;
+        state.misses[i] = copy.fleet[i].misses;
+        state.sunk[i] = copy.fleet[i].sunk;
+    }
+    
+    conn_send(c, WIRE_GAME_STATE, tag, &state, sizeof(state));
+}
+
+void handle_command(Conn* c, const WireHeader* header, const char* body) {
+    WireCommand wire;
+    if (header->length < WIRE_COMMAND_MIN) {
+        send_error(c, header->tag, WIRE_ERR_BAD_MESSAGE);
+        return;
+    }
+    memcpy(&wire, body, header->length < sizeof(wire) ? header->length : sizeof(wire));
+    if (header->length != WIRE_COMMAND_MIN + wire.name_len || wire.name_len >= MAX_NAME) {
+        send_error(c, header->tag, WIRE_ERR_BAD_MESSAGE);
+        return;
+    }
+    
+    // Канал выдается при первой команде: зрителям он не нужен
+    if (c->channel < 0) {
+        c->channel = channel_open(shared);
+        if (c->channel < 0) {
+            send_error(c, header->tag, WIRE_ERR_NO_CHANNEL);
+            return;
+        }
+        __atomic_store_n(&arena_channel(shared, c->channel)->batched, 1, __ATOMIC_RELEASE);
+        channel_conns[c->channel] = c;
+        own_channels[c->channel / 64] |= (uint64_t)1 << (c->channel % 64);
+    }
+    
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.tag = header->tag;
+    cmd.type = wire.type;
+    cmd.x = wire.x;
+    cmd.y = wire.y;
+    cmd.dir = wire.dir;
+    cmd.game_id = wire.game_id;
+    memcpy(cmd.name, wire.name, wire.name_len);
+    conn_submit(c, &cmd);
+}
+
+void handle_game_query(Conn* c, const WireHeader* header, const char* body) {
+    WireGameQuery query;
+    if (header->length != sizeof(query)) {
+        send_error(c, header->tag, WIRE_ERR_BAD_MESSAGE);
+        return;
+    }
+    memcpy(&query, body, sizeof(query));
+    
+    int game_count = __atomic_load_n(&shared->game_count, __ATOMIC_ACQUIRE);
+    if (query.game_id < 0 || query.game_id >= game_count) {
+        send_error(c, header->tag, WIRE_ERR_NO_GAME);
+        return;
+    }
+    
+    // Ожидание одно на соединение: прежнее получает ответ сразу
+    if (c->pos[LIST_WAITING] >= 0) {
+        list_remove(LIST_WAITING, c);
+        send_game_state(c, c->wait_tag, c->wait_game);
+    }
+    
+    Game* game = arena_game(&arena, query.game_id);
+    if (header->type == WIRE_WAIT_GAME &&
+        __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE) == query.seen_seq) {
+        c->wait_game = query.game_id;
+        c->wait_seq = query.seen_seq;
+        c->wait_tag = header->tag;
+        list_add(LIST_WAITING, c);
+        return;
+    }
+    send_game_state(c, header->tag, query.game_id);
+}
+
+// Разбор полученных сообщений. Останавливается, если ответ некуда
+// положить или кольцо команд канала заполнено: остаток ждет ответов
+void conn_process(Conn* c) {
+    size_t pos = 0;
+    
+    while (c->fd >= 0 && c->in_len - pos >= sizeof(WireHeader)) {
+        WireHeader header;
+        memcpy(&header, c->in + pos, sizeof(header));
+        if (header.length > WIRE_MAX_BODY) {
+            conn_close(c);
+            return;
+        }
+        if (c->in_len - pos < sizeof(header) + header.length || !conn_has_room(c)) {
+            break;
+        }
+        if (header.type == WIRE_COMMAND && c->inflight >= CHANNEL_RING_SIZE) {
+            break;
+        }
+        
+        const char* body = c->in + pos + sizeof(header);
+        switch (header.type) {
+            case WIRE_COMMAND:
+                handle_command(c, &header, body);
+                break;
+            case WIRE_GAME:
+            case WIRE_WAIT_GAME:
+                handle_game_query(c, &header, body);
+                break;
+            default:
+                send_error(c, header.tag, WIRE_ERR_BAD_MESSAGE);
+                break;
+        }
+        pos += sizeof(header) + header.length;
+    }
+    
+    if (pos > 0 && c->fd >= 0) {
+        memmove(c->in, c->in + pos, c->in_len - pos);
+        c->in_len -= pos;
+    }
+}
+
+// Маска epoll по состоянию буферов: вход читается, пока в нем есть место
+void conn_update_events(Conn* c) {
+    uint32_t events = 0;
+    if (c->in_len < sizeof(c->in)) {
+        events |= EPOLLIN;
+    }
+    if (c->out_len > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = c };
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+void conn_flush(Conn* c) {
+    if (c->fd < 0 || c->out_len == 0) {
+        return;
+    }
+    size_t sent = 0;
+    while (sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + sent, c->out_len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            conn_close(c);
+            return;
+        }
+        sent += n;
+    }
+    memmove(c->out, c->out + sent, c->out_len - sent);
+    c->out_len -= sent;
+}
+
+void conn_read(Conn* c) {
+    ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        conn_close(c);
+        return;
+    }
+    if (n > 0) {
+        c->in_len += n;
+        list_add(LIST_DIRTY, c);
+    }
+}
+
+// Сокет закрывается сразу, а канал - когда придут ответы на
+// отправленные команды и сервер выполнит CMD_LOGOUT
+void conn_close(Conn* c) {
+    if (c->fd < 0) {
+        return;
+    }
+    close(c->fd);
+    c->fd = -1;
+    c->out_len = 0;
+    list_remove(LIST_WAITING, c);
+    list_remove(LIST_DIRTY, c);
+    list_add(LIST_CLOSING, c);
+}
+
+void release_channel(int channel) {
+    uint64_t bit = (uint64_t)1 << (channel % 64);
+    uint64_t* ready = arena_at(shared, shared->ready_off);
+    own_channels[channel / 64] &= ~bit;
+    channel_conns[channel] = NULL;
+    __atomic_fetch_and(&ready[channel / 64], ~bit, __ATOMIC_RELAXED);
+    channel_close(shared, channel);
+}
+
+// Последний шаг закрытия (вне обхода событий epoll, чтобы в этой
+// итерации не осталось ссылок на освобожденное соединение)
+void conn_reap(Conn* c) {
+    if (c->inflight > 0) {
+        return;
+    }
+    
+    if (c->channel >= 0) {
+        Channel* ch = arena_channel(shared, c->channel);
+        if (!c->logout_sent && __atomic_load_n(&ch->player_idx, __ATOMIC_ACQUIRE) >= 0) {
+            Command cmd;
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.type = CMD_LOGOUT;
+            conn_submit(c, &cmd);
+            c->logout_sent = true;
+            return;
+        }
+        release_channel(c->channel);
+    }
+    
+    list_remove(LIST_CLOSING, c);
+    list_remove(LIST_OPEN, c);
+    free(c);
+}
+
+void accept_connections(int listen_fd) {
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            static bool warned = false;
+            if ((errno == EMFILE || errno == ENFILE) && !warned) {
+                fprintf(stderr, "Out of file descriptors, new connections wait in the backlog\n");
+                warned = true;
+            }
+            return;
+        }
+        
+        // Ответы короткие, склеивать их с задержкой незачем (для Unix-сокета игнорируется)
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        Conn* c = malloc(sizeof(Conn));
+        if (!c) {
+            close(fd);
+            return;
+        }
+        memset(c, 0, offsetof(Conn, in));
+        c->fd = fd;
+        c->channel = -1;
+        c->events = EPOLLIN;
+        for (int i = 0; i < LIST_COUNT; i++) {
+            c->pos[i] = -1;
+        }
+        
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        list_add(LIST_OPEN, c);
+    }
+}
+
+// ===== Связь с сервером =====
+
+void collect_channel(Conn* c) {
+    Channel* ch = arena_channel(shared, c->channel);
+    uint32_t tail = __atomic_load_n(&ch->reply_tail, __ATOMIC_ACQUIRE);
+    
+    while (ch->reply_head != tail) {
+        Reply reply = ch->replies[ch->reply_head % CHANNEL_RING_SIZE];
+        __atomic_store_n(&ch->reply_head, ch->reply_head + 1, __ATOMIC_RELEASE);
+        if (c->inflight > 0) {
+            c->inflight--;
+        }
+        
+        WireReply wire = {
+            .type = reply.type, .status = reply.status, .player_num = reply.player_num,
+            .shot_result = reply.shot_result, .game_status = reply.game_status,
+            .winner = reply.winner, .is_new = reply.is_new, .player_idx = reply.player_idx,
+            .game_id = reply.game_id, .game_gen = reply.game_gen
+        };
+        conn_send(c, WIRE_REPLY, reply.tag, &wire, sizeof(wire));
+    }
+    
+    // Кольцо освободилось - можно разобрать отложенные команды
+    if (c->fd >= 0 && c->in_len > 0) {
+        list_add(LIST_DIRTY, c);
+    }
+}
+
+// Ответы каналов, пришедшие с прошлой итерации. Обходятся только
+// каналы этого шлюза, помеченные сервером в ready_off
+void collect_replies() {
+    uint64_t* ready = arena_at(shared, shared->ready_off);
+    
+    for (uint32_t w = 0; w < shared->pending_words; w++) {
+        uint64_t bits = __atomic_load_n(&ready[w], __ATOMIC_RELAXED) & own_channels[w];
+        if (!bits) {
+            continue;
+        }
+        __atomic_fetch_and(&ready[w], ~bits, __ATOMIC_ACQUIRE);
+        
+        while (bits) {
+            int idx = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            collect_channel(channel_conns[idx]);
+        }
+    }
+}
+
+// Ответ ждущим, чьи игры изменились
+void check_waiters() {
+    ConnList* waiting = &lists[LIST_WAITING];
+    
+    for (int i = waiting->count - 1; i >= 0; i--) {
+        Conn* c = waiting->items[i];
+        Game* game = arena_game(&arena, c->wait_game);
+        if (__atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE) != c->wait_seq) {
+            list_remove(LIST_WAITING, c);
+            send_game_state(c, c->wait_tag, c->wait_game);
+        }
+    }
+}
+
+// Поток-мост: сон на change_seq в shared memory, пробуждение - в eventfd
+void* bridge_thread(void* arg) {
+    (void)arg;
+    uint32_t seen = __atomic_load_n(&shared->change_seq, __ATOMIC_ACQUIRE);
+    struct timespec timeout = { 1, 0 };
+    
+    while (running) {
+        wait_changes(shared, seen, &timeout);
+        uint32_t now = __atomic_load_n(&shared->change_seq, __ATOMIC_ACQUIRE);
+        if (now != seen) {
+            seen = now;
+            uint64_t one = 1;
+            if (write(bell_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                perror("eventfd write failed");
+            }
+        }
+    }
+    return NULL;
+}
+
+// ===== Сокеты =====
+
+int add_listener(int* fd_slot, int fd) {
+    if (listen(fd, SOMAXCONN) < 0) {
+        perror("listen failed");
+        close(fd);
+        return -1;
+    }
+    *fd_slot = fd;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = fd_slot };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int open_tcp_listener() {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(tcp_port);
+    if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Bad bind address: %s\n", bind_addr);
+        return -1;
+    }
+    
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    return add_listener(&tcp_fd, fd);
+}
+
+int open_unix_listener() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(unix_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", unix_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, unix_path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    unlink(unix_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    return add_listener(&unix_fd, fd);
+}
+
+// ===== Основной цикл =====
+
+void gateway_loop() {
+    struct epoll_event events[MAX_EVENTS];
+    
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+        
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &bell_fd) {
+                uint64_t count;
+                if (read(bell_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("eventfd read failed");
+                }
+            } else if (ptr == &tcp_fd || ptr == &unix_fd) {
+                accept_connections(*(int*)ptr);
+            } else {
+                Conn* c = ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    conn_close(c);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    conn_read(c);
+                }
+                if ((events[i].events & EPOLLOUT) && c->fd >= 0) {
+                    list_add(LIST_DIRTY, c);
+                }
+            }
+        }
+        
+        // Ответы сервера проверяются каждую итерацию: так не теряется
+        // звонок, пришедший, пока цикл разбирал сокеты
+        collect_replies();
+        check_waiters();
+        
+        // Разбор входа и отправка - по разу на соединение. Если отправка
+        // освободила место под ответы, разбираем отложенные запросы еще раз
+        ConnList* dirty = &lists[LIST_DIRTY];
+        while (dirty->count > 0) {
+            Conn* c = dirty->items[dirty->count - 1];
+            conn_process(c);
+            conn_flush(c);
+            if (c->fd >= 0 && c->in_len > 0) {
+                conn_process(c);
+                conn_flush(c);
+            }
+            if (c->fd >= 0) {
+                conn_update_events(c);
+            }
+            list_remove(LIST_DIRTY, c);
+        }
+        
+        ConnList* closing = &lists[LIST_CLOSING];
+        for (int i = closing->count - 1; i >= 0; i--) {
+            conn_reap(closing->items[i]);
+        }
+        
+        // Все команды итерации - одним пробуждением сервера
+        if (submitted > 0) {
+            wake_server(shared);
+            submitted = 0;
+        }
+    }
+}
+
+// Выход: игроки открытых соединений выходят, каналы освобождаются
+void close_all() {
+    ConnList* open = &lists[LIST_OPEN];
+    while (open->count > 0) {
+        Conn* c = open->items[open->count - 1];
+        if (c->fd >= 0) {
+            close(c->fd);
+        }
+        if (c->channel >= 0 && !c->logout_sent && c->inflight < CHANNEL_RING_SIZE &&
+            arena_channel(shared, c->channel)->player_idx >= 0) {
+            Command cmd;
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.type = CMD_LOGOUT;
+            conn_submit(c, &cmd);
+        }
+        if (c->channel >= 0) {
+            channel_close(shared, c->channel);
+        }
+        list_remove(LIST_OPEN, c);
+        free(c);
+    }
+    if (submitted > 0) {
+        wake_server(shared);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (parse_config(argc, argv) < 0) {
+        return 1;
+    }
+    
+    printf("=== Sea Battle Gateway ===\n");
+    setup_signals();
+    raise_fd_limit();
+    
+    if (connect_to_server() < 0) {
+        return 1;
+    }
+    
+    channel_conns = calloc(shared->channel_count, sizeof(Conn*));
+    own_channels = calloc(shared->pending_words, sizeof(uint64_t));
+    if (!channel_conns || !own_channels) {
+        perror("calloc failed");
+        return 1;
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    bell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || bell_fd < 0) {
+        perror("epoll/eventfd failed");
+        return 1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &bell_fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bell_fd, &ev);
+    
+    if (tcp_port != 0) {
+        if (open_tcp_listener() < 0) {
+            return 1;
+        }
+        printf("Listening on %s:%d\n", bind_addr, tcp_port);
+    }
+    if (unix_path) {
+        if (open_unix_listener() < 0) {
+            return 1;
+        }
+        printf("Listening on %s\n", unix_path);
+    }
+    
+    pthread_t bridge;
+    if (pthread_create(&bridge, NULL, bridge_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start bridge thread\n");
+        return 1;
+    }
+    
+    gateway_loop();
+    
+    printf("\nShutting down gateway (%d connections)...\n", lists[LIST_OPEN].count);
+    close_all();
+    pthread_join(bridge, NULL);
+    
+    if (unix_path) {
+        unlink(unix_path);
+    }
+    arena_detach(&arena);
+    close(mmap_fd);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "ai.h"
+#include "../shared/board.h"
+
+// Плотность вероятности: для каждой клетки считается, сколькими способами
+// в нее может лечь еще не потопленный корабль. Счетчики битово-срезаны:
+// плоскость i хранит i-й разряд счетчиков всех 100 клеток, поэтому
+// прибавление единицы к любому набору клеток - несколько операций над
+// 128-битными досками, а не цикл по клеткам
+#define AI_COUNTER_BITS 6   // Больше 36 размещений на клетку не бывает
+
+typedef struct {
+    Bitboard plane[AI_COUNTER_BITS];
+} Counters;
+
+// Прибавление 1 к счетчикам клеток cells (сложение с переносом по плоскостям)
+static void counters_add(Counters* counters, Bitboard cells) {
+    for (int i = 0; i < AI_COUNTER_BITS && cells; i++) {
+        Bitboard carry = counters->plane[i] & cells;
+        counters->plane[i] ^= cells;
+        cells = carry;
+    }
+}
+
+// Клетки из candidates с наибольшим счетчиком: от старшего разряда к
+// младшему оставляем клетки с единицей в разряде, если такие есть
+static Bitboard counters_max(const Counters* counters, Bitboard candidates) {
+    for (int i = AI_COUNTER_BITS - 1; i >= 0; i--) {
+        Bitboard top = candidates & counters->plane[i];
+        if (top) {
+            candidates = top;
+        }
+    }
+    return candidates;
+}
+
+// Клетки x <= BOARD_SIZE - size: с них горизонтальный корабль не выходит за поле
+static Bitboard anchor_columns(int size) {
+    Bitboard columns = 0;
+    for (int x = 0; x + size <= BOARD_SIZE; x++) {
+        columns |= BB_COLUMN(x);
+    }
+    return columns;
+}
+
+// Сколько кораблей каждого размера еще на плаву. Потопленные корабли не
+// касаются друг друга, поэтому каждая связная область sunk - один корабль
+static void remaining_ships(Bitboard sunk, int* count) {
+    static const int fleet[] = { 0, BOAT_COUNT, DESTROYER_COUNT, CRUISER_COUNT, BATTLESHIP_COUNT };
+    for (int size = 0; size <= 4; size++) {
+        count[size] = fleet[size];
+    }
+    
+    while (sunk) {
+        Bitboard ship = sunk & -sunk;
+        Bitboard grown;
+        while ((grown = bb_cross(ship) & sunk) != ship) {
+            ship = grown;
+        }
+        int size = bb_count(ship);
+        if (size <= 4 && count[size] > 0) {
+            count[size]--;
+        }
+        sunk &= ~ship;
+    }
+}
+
+// Добавление всех размещений корабля size в свободные клетки free.
+// Если need не 0, считаются только размещения, задевающие need
+static void add_placements(Counters* counters, Bitboard free, Bitboard need, int size, int times) {
+    // Начальные клетки размещений: корабль с началом в клетке a занимает
+    // a, a + 1, ... (по горизонтали) или a, a + 10, ... (по вертикали)
+    Bitboard horizontal = free & anchor_columns(size);
+    Bitboard vertical = free;
+    Bitboard touch_h = need, touch_v = need;
+    for (int k = 1; k < size; k++) {
+        horizontal &= free >> k;
+        vertical &= free >> (k * BOARD_SIZE);
+        touch_h |= need >> k;
+        touch_v |= need >> (k * BOARD_SIZE);
+    }
+    if (need) {
+        horizontal &= touch_h;
+        vertical &= touch_v;
+    }
+    
+    // Однопалубный корабль одинаков в обоих направлениях
+    if (size == 1) {
+        vertical = 0;
+    }
+    
+    for (int t = 0; t < times; t++) {
+        for (int k = 0; k < size; k++) {
+            counters_add(counters, (horizontal << k) & BB_BOARD);
+            counters_add(counters, (vertical << (k * BOARD_SIZE)) & BB_BOARD);
+        }
+    }
+}
+
+// n-я (с нуля) клетка доски
+static int nth_cell(Bitboard cells, int n) {
+    while (n-- > 0) {
+        cells &= cells - 1;
+    }
+    uint64_t low = (uint64_t)cells;
+    return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t)(cells >> 64));
+}
+
+uint32_t ai_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+int ai_choose_shot(const Fleet* enemy, uint64_t* rng) {
+    Bitboard shot = enemy->hits | enemy->misses;
+    Bitboard wounded = enemy->hits & ~enemy->sunk;
+    
+    // Корабль не может лежать на промахах и рядом с потопленными кораблями.
+    // Диагональные соседи раненых клеток тоже пусты: корабли прямые
+    // и не касаются даже углами
+    Bitboard diagonal = bb_neighbors(wounded) & ~bb_cross(wounded);
+    Bitboard free = BB_BOARD & ~enemy->misses & ~bb_neighbors(enemy->sunk) & ~diagonal;
+    Bitboard candidates = free & ~shot;
+    if (!candidates) {
+        candidates = BB_BOARD & ~shot;
+        if (!candidates) {
+            return -1;
+        }
+    }
+    
+    int count[5];
+    remaining_ships(enemy->sunk, count);
+    
+    // Есть раненый корабль - добиваем его: учитываем только размещения
+    // через раненые клетки. Иначе ищем по всей доске
+    Counters counters = { { 0 } };
+    for (int size = 1; size <= 4; size++) {
+        if (count[size] > 0) {
+            add_placements(&counters, free, wounded, size, count[size]);
+        }
+    }
+    
+    Bitboard best = counters_max(&counters, candidates);
+    return nth_cell(best, ai_random(rng) % bb_count(best));
+}
@@ -0,0 +1,15 @@
+#ifndef AI_H
+#define AI_H
+
+#include <stdint.h>
+#include "../shared/protocol.h"
+
+// Случайное число бота (xorshift64*), state не должен быть нулем
+uint32_t ai_random(uint64_t* state);
+
+// Выстрел бота по флоту противника. Бот видит только то, что открыли
+// выстрелы (hits, misses, sunk), расстановку целых кораблей он не читает.
+// Возвращает клетку y * BOARD_SIZE + x, -1 если стрелять некуда
+int ai_choose_shot(const Fleet* enemy, uint64_t* rng);
+
+#endif // AI_H
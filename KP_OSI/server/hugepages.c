@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <mntent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hugepages.h"
+
+// Точка монтирования hugetlbfs или NULL
+static const char* find_hugetlbfs(char* dir, size_t size) {
+    FILE* mounts = setmntent("/proc/mounts", "r");
+    if (!mounts) {
+        return NULL;
+    }
+    
+    const char* found = NULL;
+    struct mntent* entry;
+    while ((entry = getmntent(mounts)) != NULL) {
+        if (strcmp(entry->mnt_type, "hugetlbfs") == 0 && access(entry->mnt_dir, W_OK) == 0) {
+            snprintf(dir, size, "%s", entry->mnt_dir);
+            found = dir;
+            break;
+        }
+    }
+    endmntent(mounts);
+    return found;
+}
+
+int huge_segment_open(const char* name, char* path, size_t path_size, uint64_t* page_size) {
+    // Имя сегмента начинается с '/'
+    while (*name == '/') {
+        name++;
+    }
+    
+    char dir[PATH_MAX];
+    int fd;
+    if (find_hugetlbfs(dir, sizeof(dir))) {
+        snprintf(path, path_size, "%s/%s", dir, name);
+        unlink(path);
+        fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd >= 0) {
+            fchmod(fd, 0666);
+        }
+    } else {
+        fd = memfd_create(name, MFD_HUGETLB);
+        snprintf(path, path_size, "/proc/%d/fd/%d", getpid(), fd);
+    }
+    if (fd < 0) {
+        perror("Failed to create huge page segment");
+        return -1;
+    }
+    
+    // У файлов hugetlbfs и memfd с MFD_HUGETLB st_blksize - размер страницы
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat failed");
+        close(fd);
+        return -1;
+    }
+    *page_size = st.st_blksize;
+    return fd;
+}
+
+void huge_segment_unlink(const char* link) {
+    if (strncmp(link, "/proc/", 6) == 0) {
+        return;  // memfd исчезнет вместе с последним fd
+    }
+    
+    char target[PATH_MAX];
+    ssize_t len = readlink(link, target, sizeof(target) - 1);
+    if (len > 0) {
+        target[len] = '\0';
+        if (strncmp(target, "/proc/", 6) != 0) {
+            unlink(target);
+        }
+    }
+    unlink(link);
+}
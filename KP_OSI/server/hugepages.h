@@ -0,0 +1,18 @@
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Новый файл сегмента на огромных страницах: на первом смонтированном
+// hugetlbfs, иначе memfd с MFD_HUGETLB. В path - путь, по которому файл
+// откроют другие процессы (у memfd это /proc/<pid>/fd/<fd>, он действует,
+// пока сервер жив), в page_size - размер страницы. Возвращает fd или -1
+int huge_segment_open(const char* name, char* path, size_t path_size, uint64_t* page_size);
+
+// Удаление файла hugetlbfs, на который ссылается link (ссылки на memfd
+// пропускаются), затем самой ссылки или обычного файла link.
+// Путь memfd (/proc/...) не удаляется
+void huge_segment_unlink(const char* link);
+
+#endif // HUGEPAGES_H
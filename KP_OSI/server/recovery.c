@@ -0,0 +1,121 @@
+#include <string.h>
+#include "recovery.h"
+#include "../shared/events.h"
+#include "../shared/locks.h"
+#include "../shared/seqlock.h"
+
+void game_write_begin(Game* game, int fleet_idx) {
+    GameUndo* undo = &game->undo;
+    undo->fleet_idx = fleet_idx;
+    undo->in_use = game->in_use;
+    undo->generation = game->generation;
+    undo->status = game->status;
+    undo->current_turn = game->current_turn;
+    undo->winner = game->winner;
+    undo->last_move = game->last_move;
+    undo->finished_at = game->finished_at;
+    undo->player2_idx = game->player2_idx;
+    memcpy(undo->player2, game->player2, MAX_LOGIN);
+    undo->move_count = game->move_count;
+    if (fleet_idx >= 0) {
+        undo->fleet = game->fleet[fleet_idx];
+    }
+    
+    // Журнал заполнен раньше, чем начнет меняться сама игра
+    __atomic_store_n(&undo->active, 1, __ATOMIC_RELEASE);
+    seqlock_write_begin(&game->seq);
+}
+
+void game_write_end(Game* game) {
+    // Сначала закрываем seqlock: четный seq при active = 1 означает,
+    // что изменение дошло до конца
+    seqlock_write_end(&game->seq);
+    __atomic_store_n(&game->undo.active, 0, __ATOMIC_RELEASE);
+}
+
+static void rollback(Game* game) {
+    GameUndo* undo = &game->undo;
+    game->in_use = undo->in_use;
+    game->generation = undo->generation;
+    game->status = undo->status;
+    game->current_turn = undo->current_turn;
+    game->winner = undo->winner;
+    game->last_move = undo->last_move;
+    game->finished_at = undo->finished_at;
+    game->player2_idx = undo->player2_idx;
+    memcpy(game->player2, undo->player2, MAX_LOGIN);
+    __atomic_store_n(&game->move_count, undo->move_count, __ATOMIC_RELEASE);
+    if (undo->fleet_idx >= 0) {
+        game->fleet[undo->fleet_idx] = undo->fleet;
+    }
+}
+
+// Игроки, привязанные к игре, но не сидящие в ней (откатили создание
+// или присоединение), отвязываются
+static void unbind_strangers(ShmArena* arena, Game* game) {
+    SharedData* shared = arena->shared;
+    lock(&shared->players_mutex, LOCK_SERVER_RECOVERY);
+    
+    for (int i = 0; i < shared->player_count; i++) {
+        Player* p = arena_player(arena, i);
+        if (p->game_id != game->id || p->game_gen != game->generation) {
+            continue;
+        }
+        
+        bool seated = game->in_use && (i == game->player1_idx || i == game->player2_idx);
+        if (!seated) {
+            seqlock_write_begin(&p->seq);
+            p->game_id = -1;
+            p->game_gen = 0;
+            seqlock_write_end(&p->seq);
+        }
+    }
+    
+    unlock(&shared->players_mutex);
+}
+
+int recover_game(ShmArena* arena, Game* game) {
+    GameUndo* undo = &game->undo;
+    
+    // Четный seq - последнее изменение завершено (или не начиналось)
+    if (!(game->seq & 1)) {
+        undo->active = 0;
+        return 0;
+    }
+    
+    // winner появляется вместе с засчитанным итогом (finish_game): такой
+    // ход доводим до конца, даже если статус сменить не успели. Закрытие
+    // игры без победителя тоже не откатываем, потому что игроки уже
+    // освобождены; любое другое изменение откатываем
+    bool credited = game->winner != 0 && undo->winner == 0;
+    bool finished_now = credited ||
+                        (game->status == GAME_FINISHED && undo->status != GAME_FINISHED);
+    if (undo->active && !finished_now) {
+        rollback(game);
+    }
+    if (credited) {
+        game->status = GAME_FINISHED;
+    }
+    undo->active = 0;
+    seqlock_write_end(&game->seq);
+    
+    unbind_strangers(arena, game);
+    notify_game(game);
+    return 1;
+}
+
+int recover_players(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    int repaired = 0;
+    
+    // Поля игрока меняются по одному, поэтому запись остается пригодной,
+    // достаточно закрыть seqlock, иначе читатели будут ждать вечно
+    for (int i = 0; i < shared->player_count; i++) {
+        Player* p = arena_player(arena, i);
+        if (p->seq & 1) {
+            seqlock_write_end(&p->seq);
+            repaired++;
+        }
+    }
+    return repaired;
+}
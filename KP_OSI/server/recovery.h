@@ -0,0 +1,22 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include "../shared/protocol.h"
+#include "../shared/arena.h"
+
+// Изменение игры под ее мьютексом. game_write_begin записывает состояние
+// игры и флот fleet_idx (-1 - флот не меняется) в журнал отката и
+// открывает seqlock игры, game_write_end закрывает оба
+void game_write_begin(Game* game, int fleet_idx);
+void game_write_end(Game* game);
+
+// Восстановление после смерти владельца мьютекса игры (мьютекс захвачен).
+// Незавершенное изменение откатывается по журналу, привязка игроков к игре
+// сверяется с ее местами. Возвращает 1, если игру пришлось исправлять
+int recover_game(ShmArena* arena, Game* game);
+
+// То же для таблицы игроков (под players_mutex): закрывает брошенные seqlock.
+// Возвращает число исправленных записей
+int recover_players(ShmArena* arena);
+
+#endif // RECOVERY_H
@@ -5,351 +5,1712 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <errno.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
+#include <limits.h>
 #include "../shared/protocol.h"
+#include "../shared/arena.h"
+#include "../shared/board.h"
+#include "../shared/events.h"
+#include "../shared/index.h"
+#include "../shared/locks.h"
+#include "../shared/match.h"
+#include "../shared/movelog.h"
+#include "../shared/replay.h"
+#include "../shared/seqlock.h"
+#include "../shared/shard.h"
+#include "ai.h"
+#include "hugepages.h"
+#include "recovery.h"
+#include "state_store.h"
+#include "stats_store.h"
+#include "workers.h"
 
+ShmArena arena;
 SharedData* shared = NULL;
 int mmap_fd = -1;
-int running = 1;
+int segment_created = 0;        // Сегмент создан этим запуском (не остался от упавшего сервера)
+volatile sig_atomic_t running = 1;
+ArenaConfig config = { DEFAULT_MAX_PLAYERS, DEFAULT_MAX_GAMES, 0 };
+int stats_mode = 0;             // --stats: вывести статистику и выйти
+const char* stats_dir = ".";    // Каталог журнала и снимка статистики
+const char* replay_dir = NULL;  // Каталог повторов завершенных игр (NULL - не пишутся)
+
+// Шард этого сервера (shard.h). При shard_total > 1 игроки отмечаются
+// в общем каталоге, а статистика пишется в свой подкаталог stats_dir
+int shard_index = 0;
+int shard_total = 1;
+Directory* directory = NULL;
+
+// Потоков, выполняющих команды каналов (0 - по числу доступных ядер)
+int worker_count = 0;
+
+int huge_pages = 0;             // --huge-pages: сегмент на огромных страницах
+int prefault = 0;               // --prefault: страницы сегмента заполняются и закрепляются сразу
+
+// Очередь завершенных игр на освобождение. Задержка одинаковая,
+// поэтому игры стоят в порядке истечения срока
+typedef struct {
+    int id;
+    uint32_t generation;
+    time_t reclaim_at;
+} PendingReclaim;
+
+PendingReclaim* reclaim_queue = NULL;
+int reclaim_head = 0;
+int reclaim_len = 0;
+
+// Колесо таймеров присутствия. Игрок лежит в ячейке тика, к которому
+// истекает его last_seen, поэтому за тик проверяются только игроки
+// этой ячейки. Колесо трогает только основной поток сервера
+#define PRESENCE_SLOTS (PRESENCE_TIMEOUT_SEC / SERVER_TICK_SEC + 2)
+#define PRESENCE_IDLE -2        // presence_next: игрока нет в колесе
+
+int presence_wheel[PRESENCE_SLOTS];     // Голова списка ячейки (-1 - пусто)
+int* presence_next = NULL;              // Следующий игрок в ячейке (-1 - конец)
+time_t presence_tick = 0;               // Последний обработанный тик
+
+// Игроки, ждущие соперника: заявки, перенесенные из очереди подбора
+typedef struct {
+    int player_idx;
+    int channel;
+    int rating;
+    int rounds;             // Сколько раундов подбора уже прождал
+} MatchWaiter;
+
+MatchWaiter* match_waiters = NULL;
+int match_waiting = 0;
+bool* match_queued = NULL;      // Игрок уже среди ждущих (по индексу игрока)
+time_t next_match_round = 0;
+uint32_t match_games = 0;       // Номер для имени следующей игры подбора
+
+// Боты - игроки, за которых ходит сам сервер. Бот свободен, пока его
+// игрок не в игре. Логины с BOT_LOGIN_PREFIX клиентам недоступны
+#define BOT_LOGIN_PREFIX "bot#"
+
+typedef struct {
+    int player_idx;
+    uint32_t seen_seq;      // move_seq игры, на который бот уже ответил
+    uint64_t rng;
+} Bot;
+
+Bot* bots = NULL;
+int bot_count = 0;
+pthread_mutex_t bots_mutex = PTHREAD_MUTEX_INITIALIZER;    // Выдача ботов из потоков
+
+// Буфер потока: то, что меняет структуры основного потока (очередь
+// освобождения, колесо присутствия), поток копит у себя, а основной
+// поток переносит после того, как потоки закончили (merge_worker_logs)
+typedef struct {
+    PendingReclaim* reclaims;
+    int reclaim_count, reclaim_cap;
+    int* logins;            // Игроки для колеса присутствия
+    int login_count, login_cap;
+} WorkerLog;
+
+WorkerLog* worker_logs = NULL;
+int worker_log_count = 0;       // Буферов выделено (пул может быть уже остановлен)
+int* pending_tasks = NULL;      // Каналы с командами текущей итерации
+
+// Место под еще один элемент буфера (NULL при нехватке памяти)
+void* log_append(void** items, int* count, int* cap, size_t size) {
+    if (*count == *cap) {
+        int grown_cap = *cap ? *cap * 2 : 64;
+        void* grown = realloc(*items, grown_cap * size);
+        if (!grown) {
+            return NULL;
+        }
+        *items = grown;
+        *cap = grown_cap;
+    }
+    return (char*)*items + (*count)++ * size;
+}
+
+WorkerLog* worker_log() {
+    return &worker_logs[worker_self()];
+}
+
+// Очередь освобождения (только основной поток)
+void enqueue_reclaim(const PendingReclaim* item) {
+    int tail = (reclaim_head + reclaim_len) % arena_game_limit(shared);
+    reclaim_queue[tail] = *item;
+    reclaim_len++;
+}
+
+// Завершенная игра освобождается через GAME_RECLAIM_SEC секунд,
+// чтобы игроки успели увидеть результат (под мьютексом игры).
+// В очередь она попадает при слиянии буфера потока
+void schedule_reclaim(Game* game) {
+    game->finished_at = time(NULL);
+    
+    WorkerLog* log = worker_log();
+    PendingReclaim* item = log_append((void**)&log->reclaims, &log->reclaim_count,
+                                      &log->reclaim_cap, sizeof(PendingReclaim));
+    if (!item) {
+        fprintf(stderr, "Warning: game '%s' will not be recycled (out of memory)\n", game->name);
+        return;
+    }
+    item->id = game->id;
+    item->generation = game->generation;
+    item->reclaim_at = game->finished_at + GAME_RECLAIM_SEC;
+}
 
 // Обработчик Ctrl+C
 void handle_signal(int sig) {
+    (void)sig;
     printf("\nShutting down server...\n");
     running = 0;
+    
+    // Сдвигаем event_seq, чтобы futex_wait не уснул после проверки running
+    if (shared) {
+        __atomic_fetch_add(&shared->event_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&shared->event_seq, 1);
+    }
+}
+
+// Без SA_RESTART, чтобы сигнал прерывал futex_wait в server_loop
+void setup_signals() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+// Доступ к записям в арене
+Player* get_player(int idx) {
+    return arena_player(&arena, idx);
+}
+
+Game* get_game(int id) {
+    return arena_game(&arena, id);
+}
+
+// Мьютекс захвачен после смерти прежнего владельца: данные под ним
+// приводятся в порядок до того, как их увидит кто-то еще
+void on_owner_death(pthread_mutex_t* mutex) {
+    if (mutex == &shared->mutex) {
+        arena_rebuild_games(&arena);
+        index_rebuild_games(&arena);
+        printf("Recovered games list after owner death\n");
+        return;
+    }
+    if (mutex == &shared->players_mutex) {
+        printf("Recovered players table after owner death (%d records repaired)\n",
+               recover_players(&arena));
+        return;
+    }
+    
+    for (int i = 0; i < arena_game_capacity(shared); i++) {
+        Game* game = get_game(i);
+        if (&game->mutex == mutex) {
+            if (recover_game(&arena, game)) {
+                printf("Recovered interrupted change of game '%s' (slot %d)\n",
+                       game->in_use ? game->name : "-", i);
+            }
+            return;
+        }
+    }
+}
+
+// Упавший сервер мог оставить мьютексы захваченными: захват каждого
+// вызывает on_owner_death. Игры проверяются раньше списка игр, потому что
+// список перестраивается по их флагам in_use
+void recover_shared_state() {
+    for (int i = 0; i < arena_game_capacity(shared); i++) {
+        lock(&get_game(i)->mutex, LOCK_SERVER_RECOVERY);
+        unlock(&get_game(i)->mutex);
+    }
+    lock(&shared->players_mutex, LOCK_SERVER_RECOVERY);
+    unlock(&shared->players_mutex);
+    lock(&shared->mutex, LOCK_SERVER_RECOVERY);
+    unlock(&shared->mutex);
+}
+
+// Чтение положительного числа из строки (0 - ошибка)
+uint32_t parse_capacity(const char* value) {
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (*end != '\0' || n <= 0 || n > 1000000) {
+        return 0;
+    }
+    return (uint32_t)n;
+}
+
+// Начальная емкость: переменные окружения, затем аргументы командной строки
+int parse_config(int argc, char* argv[]) {
+    const char* env_players = getenv("SEA_BATTLE_MAX_PLAYERS");
+    const char* env_games = getenv("SEA_BATTLE_MAX_GAMES");
+    
+    if (env_players) config.max_players = parse_capacity(env_players);
+    if (env_games) config.max_games = parse_capacity(env_games);
+    if (getenv("SEA_BATTLE_STATS_DIR")) stats_dir = getenv("SEA_BATTLE_STATS_DIR");
+    if (getenv("SEA_BATTLE_REPLAY_DIR")) replay_dir = getenv("SEA_BATTLE_REPLAY_DIR");
+    if (getenv("SEA_BATTLE_SHARDS")) shard_total = atoi(getenv("SEA_BATTLE_SHARDS"));
+    if (getenv("SEA_BATTLE_SHARD")) shard_index = atoi(getenv("SEA_BATTLE_SHARD"));
+    if (getenv("SEA_BATTLE_WORKERS")) worker_count = atoi(getenv("SEA_BATTLE_WORKERS"));
+    if (getenv("SEA_BATTLE_HUGE_PAGES")) huge_pages = atoi(getenv("SEA_BATTLE_HUGE_PAGES"));
+    if (getenv("SEA_BATTLE_PREFAULT")) prefault = atoi(getenv("SEA_BATTLE_PREFAULT"));
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-players") == 0 && i + 1 < argc) {
+            config.max_players = parse_capacity(argv[++i]);
+        } else if (strcmp(argv[i], "--max-games") == 0 && i + 1 < argc) {
+            config.max_games = parse_capacity(argv[++i]);
+        } else if (strcmp(argv[i], "--stats-dir") == 0 && i + 1 < argc) {
+            stats_dir = argv[++i];
+        } else if (strcmp(argv[i], "--replay-dir") == 0 && i + 1 < argc) {
+            replay_dir = argv[++i];
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shard_total = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            shard_index = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            huge_pages = 1;
+        } else if (strcmp(argv[i], "--prefault") == 0) {
+            prefault = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--max-players N] [--max-games N] [--stats-dir DIR]\n"
+                            "          [--replay-dir DIR] [--shards N --shard K] [--workers N]\n"
+                            "          [--huge-pages] [--prefault]\n"
+                            "       %s --stats [--shard K]\n", argv[0], argv[0]);
+            return -1;
+        }
+    }
+    
+    if (shard_total < 1 || shard_total > MAX_SHARDS || shard_index < 0 ||
+        (shard_index >= shard_total && !stats_mode)) {
+        fprintf(stderr, "Shard must be from 0 to shards - 1, shards from 1 to %d\n", MAX_SHARDS);
+        return -1;
+    }
+    
+    if (config.max_players == 0 || config.max_games == 0) {
+        fprintf(stderr, "Capacity must be a positive number\n");
+        return -1;
+    }
+    
+    if (worker_count < 0 || worker_count > MAX_WORKERS) {
+        fprintf(stderr, "Workers must be from 1 to %d (0 - one per CPU)\n", MAX_WORKERS);
+        return -1;
+    }
+    return 0;
+}
+
+// Привязка к ядру номер shard_index (по кругу, если ядер меньше, чем шардов).
+// Возвращает ядро или -1
+int pin_to_cpu() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int cpu = shard_index % (cpus > 0 ? cpus : 1);
+    
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return cpu;
+}
+
+// Шард: свой подкаталог статистики, отметка в каталоге шардов и ядро.
+// Вызывается до запуска потоков, чтобы они унаследовали привязку
+int init_shard() {
+    if (shard_total == 1) {
+        return 0;
+    }
+    
+    static char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/shard-%d", stats_dir, shard_index);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        perror("Failed to create shard statistics directory");
+        return -1;
+    }
+    stats_dir = dir;
+    
+    directory = directory_create(shard_total);
+    if (!directory) {
+        return -1;
+    }
+    
+    int cpu = pin_to_cpu();
+    directory_register_shard(directory, shard_index, cpu);
+    printf("Shard %d of %d, CPU %d\n", shard_index, shard_total, cpu);
+    return 0;
+}
+
+// Новый сегмент на огромных страницах. Клиенты находят его по ссылке на
+// месте файла-замены: shm-объект с тем же именем удаляется, и shard_open
+// переходит к файлу. Возвращает -1, если огромных страниц нет
+int create_huge_segment() {
+    char name[64], link[PATH_MAX], path[PATH_MAX];
+    shard_shm_name(name, sizeof(name), shard_index, shard_total);
+    shard_mmap_file(link, sizeof(link), shard_index, shard_total);
+    
+    ArenaConfig huge = config;
+    int fd = huge_segment_open(name, path, sizeof(path), &huge.page_size);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    // Страницы резервируются при отображении: если их не хватает
+    // (vm.nr_hugepages), arena_create не удается
+    if (arena_create(&arena, fd, &huge) < 0) {
+        close(fd);
+        huge_segment_unlink(path);
+        return -1;
+    }
+    
+    shm_unlink(name);
+    unlink(link);
+    if (symlink(path, link) < 0) {
+        perror("Failed to publish huge page segment");
+        arena_detach(&arena);
+        close(fd);
+        huge_segment_unlink(path);
+        return -1;
+    }
+    
+    mmap_fd = fd;
+    printf("Segment on %llu kB huge pages: %s\n",
+           (unsigned long long)huge.page_size / 1024, path);
+    return 0;
+}
+
+// Инициализация shared memory
+int init_shared_memory() {
+    arena.prefault = prefault;
+    
+    // Пробуем открыть существующую shared memory
+    mmap_fd = shard_open(shard_index, shard_total, O_RDWR);
+    int ret = mmap_fd >= 0 ? arena_attach(&arena, mmap_fd, PROT_READ | PROT_WRITE) : -2;
+    if (ret == -1) {
+        close(mmap_fd);
+        return -1;
+    }
+    
+    if (ret == -2) {
+        // Первый запуск или сегмент другой версии - создаем заново.
+        // Прежний файл сегмента (и файл hugetlbfs за ссылкой) удаляется
+        if (mmap_fd >= 0) {
+            close(mmap_fd);
+        }
+        char link[PATH_MAX];
+        shard_mmap_file(link, sizeof(link), shard_index, shard_total);
+        huge_segment_unlink(link);
+        
+        if (!huge_pages || create_huge_segment() < 0) {
+            if (huge_pages) {
+                printf("Huge pages are not available, using regular pages\n");
+            }
+            
+            // Иначе создаем shm-объект или файл mmap
+            mmap_fd = shard_open(shard_index, shard_total, O_CREAT | O_RDWR);
+            if (mmap_fd < 0) {
+                perror("Failed to open mmap file");
+                return -1;
+            }
+            if (arena_create(&arena, mmap_fd, &config) < 0) {
+                close(mmap_fd);
+                return -1;
+            }
+        }
+        shared = arena.shared;
+        segment_created = 1;
+        
+        printf("Initialized new shared memory with POSIX mutexes\n");
+        
+        // Состояние, сохраненное прошлым запуском при остановке
+        int restored = state_load(&arena, stats_dir);
+        if (restored < 0) {
+            fprintf(stderr, "Failed to restore server state\n");
+            return -1;
+        }
+        if (!restored) {
+            __atomic_store_n(&shared->epoch, 1, __ATOMIC_RELEASE);
+        } else {
+            printf("Restored %d players and %d games from %s/%s (run %u)\n",
+                   shared->player_count, shared->live_count, stats_dir,
+                   STATE_SNAPSHOT_FILE, shared->epoch);
+        }
+    } else {
+        shared = arena.shared;
+        shared->prefaulted = prefault;
+        printf("Using existing shared memory\n");
+        
+        // Исправляем данные, брошенные упавшим сервером посреди изменения
+        locks_init(shared);
+        recover_shared_state();
+    }
+    
+    printf("Capacity: %u players, %u games per chunk, up to %d chunks\n",
+           shared->players_per_chunk, shared->games_per_chunk, ARENA_MAX_CHUNKS);
+    if (prefault) {
+        printf("Segment pages are pre-faulted and locked (%llu kB pages)\n",
+               (unsigned long long)shared->arena_align / 1024);
+    }
+    
+    reclaim_queue = calloc(arena_game_limit(shared), sizeof(PendingReclaim));
+    if (!reclaim_queue) {
+        perror("calloc failed");
+        return -1;
+    }
+    
+    // Завершенные игры от прошлого запуска тоже ставим в очередь
+    for (int i = 0; i < arena_game_capacity(shared); i++) {
+        Game* game = get_game(i);
+        if (game->in_use && game->status == GAME_FINISHED) {
+            game->finished_at = time(NULL);
+            PendingReclaim item = { game->id, game->generation, game->finished_at + GAME_RECLAIM_SEC };
+            enqueue_reclaim(&item);
+        }
+    }
+    
+    return 0;
+}
+
+// Поиск игрока по логину через хеш-индекс (под players_mutex)
+int find_player(const char* login) {
+    return index_find_player(&arena, login, hash_string(login));
+}
+
+// Добавление нового игрока (под players_mutex)
+int add_player(const char* login) {
+    int idx = find_player(login);
+    if (idx >= 0) {
+        // Игрок уже существует
+        Player* p = get_player(idx);
+        seqlock_write_begin(&p->seq);
+        p->online = true;
+        seqlock_write_end(&p->seq);
+        __atomic_store_n(&p->last_seen, time(NULL), __ATOMIC_RELAXED);
+        return idx;
+    }
+    
+    // Проверяем лимит, при необходимости добавляем чанк
+    if (shared->player_count >= arena_player_capacity(shared) &&
+        arena_add_player_chunk(&arena) < 0) {
+        return -1;
+    }
+    
+    // Создаем нового игрока
+    Player* p = get_player(shared->player_count);
+    strncpy(p->login, login, MAX_LOGIN - 1);
+    p->login_hash = hash_string(p->login);
+    p->wins = 0;
+    p->losses = 0;
+    p->online = true;
+    p->game_id = -1;
+    p->last_seen = time(NULL);
+    p->ships_placed = false;
+    
+    index_insert_player(&arena, shared->player_count);
+    __atomic_store_n(&shared->player_count, shared->player_count + 1, __ATOMIC_RELEASE);
+    return shared->player_count - 1;
+}
+
+// Восстановление статистики из хранилища: игрок создается оффлайн
+void restore_player_stats(const char* login, int wins, int losses) {
+    int idx = find_player(login);
+    int created = idx < 0;
+    if (created) {
+        idx = add_player(login);
+        if (idx < 0) {
+            fprintf(stderr, "Warning: no room to restore player '%s'\n", login);
+            return;
+        }
+    }
+    
+    Player* p = get_player(idx);
+    seqlock_write_begin(&p->seq);
+    if (created) {
+        p->online = false;
+    }
+    p->wins += wins;
+    p->losses += losses;
+    seqlock_write_end(&p->seq);
+}
+
+// Снимок статистики всех игроков для хранилища (под players_mutex)
+void compact_stats() {
+    StatsEntry* entries = calloc(shared->player_count + 1, sizeof(StatsEntry));
+    if (!entries) {
+        return;
+    }
+    
+    for (int i = 0; i < shared->player_count; i++) {
+        Player* p = get_player(i);
+        strcpy(entries[i].login, p->login);
+        entries[i].wins = p->wins;
+        entries[i].losses = p->losses;
+    }
+    stats_compact(entries, shared->player_count);
+}
+
+// Открытие хранилища статистики. В новый сегмент статистика загружается
+// из снимка и журнала; уцелевший сегмент свежее диска, поэтому с него
+// сразу делается снимок
+int init_stats_store() {
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    
+    int fresh = segment_created;
+    int ret = stats_open(stats_dir, fresh ? restore_player_stats : NULL);
+    if (ret == 0 && !fresh) {
+        compact_stats();
+    }
+    if (ret == 0 && fresh) {
+        printf("Player statistics: %d players loaded from %s\n", shared->player_count, stats_dir);
+    }
+    
+    unlock(&shared->players_mutex);
+    return ret;
+}
+
+// Поиск игры по имени через хеш-индекс (под mutex)
+int find_game(const char* name) {
+    return index_find_game(&arena, name, hash_string(name));
+}
+
+// Проверка возможности размещения корабля: маска корабля не должна
+// пересекаться с кораблями флота и их соседними клетками
+int can_place_ship(const Fleet* fleet, int x, int y, int size, ShipDirection dir) {
+    return fleet_can_place(fleet, x, y, size, dir);
+}
+
+// Размещение корабля на доске
+void place_ship_on_board(Fleet* fleet, int x, int y, int size, ShipDirection dir) {
+    fleet_place(fleet, x, y, size, dir);
+}
+
+// Обработка выстрела игрока player_num по флоту противника.
+// -1 неверные координаты, -2 уже стреляли, 0 промах, 1 попадание, 2 потоплен
+int process_shot(Game* game, int player_num, int x, int y) {
+    Fleet* target = &game->fleet[player_num == 1 ? 1 : 0];
+    return fleet_shot(target, x, y);
+}
+
+// Проверка окончания игры после того, как player_num потопил корабль.
+// Флот противника мог опустеть только от этого выстрела, поэтому
+// достаточно посмотреть на его счетчик. Возвращает номер победителя или 0
+int check_game_over(Game* game, int player_num) {
+    if (fleet_destroyed(&game->fleet[player_num == 1 ? 1 : 0])) {
+        return player_num;
+    }
+    return 0;  // Игра продолжается
+}
+
+// Смена присутствия игрока (players_mutex берется здесь).
+// Ушедший игрок снимается и с отметки в каталоге шардов
+void set_player_online(int player_idx, bool online) {
+    Player* p = get_player(player_idx);
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    seqlock_write_begin(&p->seq);
+    p->online = online;
+    seqlock_write_end(&p->seq);
+    unlock(&shared->players_mutex);
+    
+    if (directory && !online) {
+        directory_release(directory, p->login, p->login_hash, shard_index);
+    }
+}
+
+// Постановка игрока в колесо к сроку его last_seen. Срок дальше
+// оборота колеса ставится в последнюю ячейку и переносится при проверке
+void presence_schedule(int idx) {
+    if (presence_next[idx] != PRESENCE_IDLE) {
+        return;  // Уже ждет проверки
+    }
+    
+    time_t last_seen = __atomic_load_n(&get_player(idx)->last_seen, __ATOMIC_RELAXED);
+    time_t tick = (last_seen + PRESENCE_TIMEOUT_SEC) / SERVER_TICK_SEC + 1;
+    if (tick <= presence_tick) {
+        tick = presence_tick + 1;
+    } else if (tick >= presence_tick + PRESENCE_SLOTS) {
+        tick = presence_tick + PRESENCE_SLOTS - 1;
+    }
+    
+    int slot = tick % PRESENCE_SLOTS;
+    presence_next[idx] = presence_wheel[slot];
+    presence_wheel[slot] = idx;
+}
+
+int init_presence() {
+    presence_next = malloc(arena_player_limit(shared) * sizeof(int));
+    if (!presence_next) {
+        perror("malloc failed");
+        return -1;
+    }
+    for (int i = 0; i < arena_player_limit(shared); i++) {
+        presence_next[i] = PRESENCE_IDLE;
+    }
+    for (int i = 0; i < PRESENCE_SLOTS; i++) {
+        presence_wheel[i] = -1;
+    }
+    presence_tick = time(NULL) / SERVER_TICK_SEC;
+    
+    // Игроки, оставшиеся онлайн от прошлого запуска
+    for (int i = 0; i < shared->player_count; i++) {
+        if (get_player(i)->online) {
+            presence_schedule(i);
+        }
+    }
+    return 0;
+}
+
+// Очистка неактивных игроков: проверяются только ячейки колеса, срок
+// которых наступил. Кто успел обновить last_seen, переносится на новый срок
+void cleanup_inactive_players(time_t now) {
+    time_t tick = now / SERVER_TICK_SEC;
+    if (tick - presence_tick > PRESENCE_SLOTS) {
+        presence_tick = tick - PRESENCE_SLOTS;
+    }
+    
+    while (presence_tick < tick) {
+        presence_tick++;
+        int slot = presence_tick % PRESENCE_SLOTS;
+        int idx = presence_wheel[slot];
+        presence_wheel[slot] = -1;
+        
+        while (idx >= 0) {
+            int next = presence_next[idx];
+            presence_next[idx] = PRESENCE_IDLE;
+            
+            // Потоки пула сейчас ждут, а online меняется только в них
+            // и в этом потоке, поэтому читается без блокировки
+            Player* p = get_player(idx);
+            time_t last_seen = __atomic_load_n(&p->last_seen, __ATOMIC_RELAXED);
+            if (p->online && now - last_seen > PRESENCE_TIMEOUT_SEC) {
+                set_player_online(idx, false);
+            } else if (p->online) {
+                presence_schedule(idx);
+            }
+            idx = next;
+        }
+    }
+}
+
+// Страничные ошибки сервера для вывода статуса
+void record_page_faults() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        __atomic_store_n(&shared->server_minflt, usage.ru_minflt, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->server_majflt, usage.ru_majflt, __ATOMIC_RELAXED);
+    }
+}
+
+// Вывод статуса сервера и статистики блокировок (режим --stats).
+// Сегмент отображен только для чтения, поэтому мьютексы не берутся и
+// счетчики могут немного расходиться между собой
+void dump_stats() {
+    printf("\n=== Server Status ===\n");
+    
+    int* ids = malloc(arena_game_limit(shared) * sizeof(int));
+    int live = arena_live_games(&arena, ids);
+    
+    int waiting = 0, placing = 0, playing = 0, finished = 0;
+    for (int i = 0; i < live; i++) {
+        switch (get_game(ids[i])->status) {
+            case GAME_WAITING: waiting++; break;
+            case GAME_PLACING_SHIPS: placing++; break;
+            case GAME_PLAYING: playing++; break;
+            case GAME_FINISHED: finished++; break;
+        }
+    }
+    free(ids);
+    
+    int player_count = __atomic_load_n(&shared->player_count, __ATOMIC_ACQUIRE);
+    int online = 0;
+    for (int i = 0; i < player_count; i++) {
+        if (get_player(i)->online) online++;
+    }
+    
+    printf("Players: %d/%d (online: %d)\n", player_count, arena_player_capacity(shared), online);
+    printf("Games: %d/%d\n", live, arena_game_capacity(shared));
+    printf("Games status: waiting=%d, placing=%d, playing=%d, finished=%d\n",
+           waiting, placing, playing, finished);
+    
+    // Ошибки после подготовки - первые касания страниц уже во время игры
+    uint64_t minflt = __atomic_load_n(&shared->server_minflt, __ATOMIC_RELAXED);
+    printf("\n=== Memory ===\n");
+    printf("Segment: %.1f of %.1f MB, %llu kB pages%s\n",
+           __atomic_load_n(&shared->arena_size, __ATOMIC_ACQUIRE) / 1048576.0,
+           shared->arena_max_size / 1048576.0,
+           (unsigned long long)shared->arena_align / 1024,
+           shared->prefaulted ? ", pre-faulted and locked" : "");
+    printf("Server page faults: minor %llu (%llu after start-up), major %llu\n",
+           (unsigned long long)minflt, (unsigned long long)(minflt - shared->setup_minflt),
+           (unsigned long long)__atomic_load_n(&shared->server_majflt, __ATOMIC_RELAXED));
+    
+    printf("\n=== Lock Statistics ===\n");
+    printf("%-24s %10s %10s %10s %10s %10s %10s %6s\n", "site", "acquired", "contended",
+           "wait avg", "wait p99", "hold avg", "hold p99", "died");
+    
+    for (int site = 0; site < LOCK_SITE_COUNT; site++) {
+        LockStats* st = &shared->lock_stats[site];
+        uint64_t acquired = __atomic_load_n(&st->acquired, __ATOMIC_RELAXED);
+        uint64_t contended = __atomic_load_n(&st->contended, __ATOMIC_RELAXED);
+        if (acquired == 0) {
+            continue;
+        }
+        
+        // Время в микросекундах
+        printf("%-24s %10llu %10llu %10.1f %10.1f %10.1f %10.1f %6llu\n",
+               lock_site_name(site),
+               (unsigned long long)acquired, (unsigned long long)contended,
+               contended ? st->wait_ns / 1000.0 / contended : 0.0,
+               lock_hist_percentile(st->wait_hist, 99) / 1000.0,
+               st->hold_ns / 1000.0 / acquired,
+               lock_hist_percentile(st->hold_hist, 99) / 1000.0,
+               (unsigned long long)__atomic_load_n(&st->owner_died, __ATOMIC_RELAXED));
+    }
+    printf("(times in microseconds; percentiles are histogram bucket upper bounds;\n"
+           " died - acquisitions after the previous owner died holding the mutex)\n");
+}
+
+// Подключение только для чтения и вывод статистики работающего сервера
+int run_stats_mode() {
+    if (shard_total == 1) {
+        shard_total = shard_count_lookup();
+    }
+    mmap_fd = shard_open(shard_index, shard_total, O_RDONLY);
+    if (mmap_fd < 0) {
+        printf("Server is not running\n");
+        return 1;
+    }
+    
+    if (arena_attach(&arena, mmap_fd, PROT_READ) < 0) {
+        printf("Shared memory not properly initialized by server\n");
+        close(mmap_fd);
+        return 1;
+    }
+    shared = arena.shared;
+    
+    dump_stats();
+    
+    arena_detach(&arena);
+    close(mmap_fd);
+    return 0;
+}
+
+// Возврат в список свободных игр, у которых истек срок.
+// Возвращает время следующего освобождения (0 - очередь пуста)
+time_t reclaim_finished_games(time_t now) {
+    while (reclaim_len > 0) {
+        PendingReclaim* item = &reclaim_queue[reclaim_head];
+        if (item->reclaim_at > now) {
+            return item->reclaim_at;
+        }
+        
+        lock(&shared->mutex, LOCK_SERVER_RECLAIM);
+        Game* game = get_game(item->id);
+        lock(&game->mutex, LOCK_SERVER_RECLAIM);
+        
+        if (game->in_use && game->generation == item->generation) {
+            printf("Game '%s' recycled (slot %d)\n", game->name, game->id);
+            index_remove_game(&arena, game->id);
+            arena_free_game(&arena, game->id);
+        }
+        
+        unlock(&game->mutex);
+        unlock(&shared->mutex);
+        
+        reclaim_head = (reclaim_head + 1) % arena_game_limit(shared);
+        reclaim_len--;
+    }
+    return 0;
+}
+
+// Игрок освобождается от завершенной игры (под players_mutex)
+void release_player(int idx) {
+    if (idx < 0) {
+        return;
+    }
+    
+    Player* p = get_player(idx);
+    seqlock_write_begin(&p->seq);
+    p->game_id = -1;
+    seqlock_write_end(&p->seq);
+}
+
+// Победа или поражение игрока (под players_mutex)
+void credit_player(int idx, int won) {
+    if (idx < 0) {
+        return;
+    }
+    
+    Player* p = get_player(idx);
+    seqlock_write_begin(&p->seq);
+    if (won) {
+        p->wins++;
+    } else {
+        p->losses++;
+    }
+    seqlock_write_end(&p->seq);
+}
+
+// Завершение игры победой winner (под мьютексом игры, внутри game_write_begin).
+// Итог засчитывается игрокам и уходит в журнал статистики одним захватом
+// players_mutex вместе с освобождением игроков. В том же захвате пишется
+// winner: по нему восстановление узнает, что итог уже засчитан, и доводит
+// игру до конца вместо отката
+void finish_game(Game* game, int winner) {
+    int winner_idx = (winner == 1) ? game->player1_idx : game->player2_idx;
+    int loser_idx = (winner == 1) ? game->player2_idx : game->player1_idx;
+    
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    credit_player(winner_idx, 1);
+    credit_player(loser_idx, 0);
+    
+    // Результат уходит в журнал; fsync делает поток хранилища
+    stats_record_game(winner_idx >= 0 ? get_player(winner_idx)->login : "",
+                      loser_idx >= 0 ? get_player(loser_idx)->login : "");
+    
+    release_player(winner_idx);
+    release_player(loser_idx);
+    game->winner = winner;
+    unlock(&shared->players_mutex);
+    
+    // Журнал ходов уже содержит завершающий выстрел
+    if (replay_dir) {
+        replay_save(replay_dir, game, winner);
+    }
+    
+    __atomic_store_n(&game->status, GAME_FINISHED, __ATOMIC_RELEASE);
+    
+    printf("Game '%s' finished. Winner: %s\n",
+           game->name, winner == 1 ? game->player1 : game->player2);
+    
+    schedule_reclaim(game);
+}
+
+// Привязка игрока к игре (под мьютексом игры)
+void set_player_game(int player_idx, Game* game) {
+    Player* p = get_player(player_idx);
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    seqlock_write_begin(&p->seq);
+    p->game_id = game ? game->id : -1;
+    p->game_gen = game ? game->generation : 0;
+    seqlock_write_end(&p->seq);
+    unlock(&shared->players_mutex);
+}
+
+// Игра игрока под ее мьютексом, NULL если игрок не в игре.
+// game_id игроков меняет только сервер, поэтому читаем его без players_mutex.
+// Чужой поток меняет его только под мьютексом игры (завершая ее),
+// поэтому привязка перепроверяется после захвата
+Game* lock_player_game(int player_idx, int* player_num) {
+    Player* p = get_player(player_idx);
+    int game_id = __atomic_load_n(&p->game_id, __ATOMIC_ACQUIRE);
+    if (game_id < 0) {
+        return NULL;
+    }
+    
+    Game* game = get_game(game_id);
+    lock(&game->mutex, LOCK_SERVER_GAME_COMMAND);
+    if (!game->in_use || p->game_id != game_id || game->generation != p->game_gen) {
+        unlock(&game->mutex);
+        return NULL;
+    }
+    
+    *player_num = (game->player1_idx == player_idx) ? 1 : 2;
+    return game;
+}
+
+// Текущая игра игрока в ответе
+void fill_reply(Reply* reply, int player_idx) {
+    reply->player_idx = player_idx;
+    
+    int player_num;
+    Game* game = lock_player_game(player_idx, &player_num);
+    if (game) {
+        reply->game_id = game->id;
+        reply->game_gen = game->generation;
+        reply->player_num = player_num;
+        reply->game_status = game->status;
+        reply->winner = game->winner;
+        unlock(&game->mutex);
+    } else {
+        reply->game_id = -1;
+    }
+}
+
+bool is_bot_login(const char* login) {
+    return strncmp(login, BOT_LOGIN_PREFIX, strlen(BOT_LOGIN_PREFIX)) == 0;
+}
+
+int cmd_login(Channel* ch, const Command* cmd, Reply* reply) {
+    char login[MAX_LOGIN];
+    strncpy(login, cmd->name, MAX_LOGIN - 1);
+    login[MAX_LOGIN - 1] = '\0';
+    
+    if (strlen(login) < 3 || is_bot_login(login)) {
+        return REPLY_BAD_STATE;
+    }
+    
+    // Один игрок в сети только на одном шарде
+    if (directory) {
+        int ret = directory_claim(directory, login, hash_string(login), shard_index);
+        if (ret < 0) {
+            return ret == -1 ? REPLY_ELSEWHERE : REPLY_FULL;
+        }
+    }
+    
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    int count = shared->player_count;
+    int idx = add_player(login);
+    unlock(&shared->players_mutex);
+    
+    if (idx < 0) {
+        if (directory) {
+            directory_release(directory, login, hash_string(login), shard_index);
+        }
+        return REPLY_FULL;
+    }
+    
+    ch->player_idx = idx;
+    reply->is_new = idx >= count;
+    
+    // В колесо присутствия игрок попадет при слиянии буфера потока
+    WorkerLog* log = worker_log();
+    int* entry = log_append((void**)&log->logins, &log->login_count, &log->login_cap, sizeof(int));
+    if (entry) {
+        *entry = idx;
+    }
+    return REPLY_OK;
 }
 
-// Функции синхронизации с мьютексами
-void lock() {
-    int ret = pthread_mutex_lock(&shared->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "Ошибка блокировки мьютекса: %s\n", strerror(ret));
-        exit(1);
+int cmd_create_game(int player_idx, const Command* cmd) {
+    char name[MAX_NAME];
+    strncpy(name, cmd->name, MAX_NAME - 1);
+    name[MAX_NAME - 1] = '\0';
+    
+    if (name[0] == '\0' || get_player(player_idx)->game_id >= 0) {
+        return REPLY_BAD_STATE;
+    }
+    
+    lock(&shared->mutex, LOCK_SERVER_CREATE_GAME);
+    
+    // Проверяем что имя не занято
+    if (find_game(name) >= 0) {
+        unlock(&shared->mutex);
+        return REPLY_NAME_TAKEN;
     }
+    
+    // Берем свободный слот (при нехватке сегмент растет на чанк)
+    int id = arena_alloc_game(&arena);
+    if (id < 0) {
+        unlock(&shared->mutex);
+        return REPLY_FULL;
+    }
+    
+    Game* game = get_game(id);
+    lock(&game->mutex, LOCK_SERVER_CREATE_GAME);
+    
+    game_write_begin(game, -1);
+    game->id = id;
+    game->in_use = true;
+    strcpy(game->name, name);
+    game->name_hash = hash_string(name);
+    strcpy(game->player1, get_player(player_idx)->login);
+    game->player2[0] = '\0';
+    game->player1_idx = player_idx;
+    game->player2_idx = -1;
+    game->status = GAME_WAITING;
+    game->current_turn = 1;
+    game->winner = 0;
+    game->last_move = time(NULL);
+    memset(game->fleet, 0, sizeof(game->fleet));
+    __atomic_store_n(&game->move_count, 0, __ATOMIC_RELEASE);
+    
+    // Публикуем игру для остальных процессов
+    index_insert_game(&arena, id);
+    arena_publish_game(&arena, id);
+    set_player_game(player_idx, game);
+    game_write_end(game);
+    
+    unlock(&game->mutex);
+    unlock(&shared->mutex);
+    
+    printf("Game '%s' created by %s\n", name, game->player1);
+    return REPLY_OK;
 }
 
-void unlock() {
-    int ret = pthread_mutex_unlock(&shared->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "Ошибка разблокировки мьютекса: %s\n", strerror(ret));
-        exit(1);
+int cmd_join_game(int player_idx, const Command* cmd) {
+    int id = cmd->game_id;
+    
+    if (get_player(player_idx)->game_id >= 0) {
+        return REPLY_BAD_STATE;
+    }
+    if (id < 0 || id >= __atomic_load_n(&shared->game_count, __ATOMIC_ACQUIRE)) {
+        return REPLY_NOT_AVAILABLE;
+    }
+    
+    Game* game = get_game(id);
+    lock(&game->mutex, LOCK_SERVER_GAME_COMMAND);
+    
+    if (!game->in_use || game->status != GAME_WAITING || game->player2_idx >= 0) {
+        unlock(&game->mutex);
+        return REPLY_NOT_AVAILABLE;
     }
+    
+    game_write_begin(game, -1);
+    strcpy(game->player2, get_player(player_idx)->login);
+    game->player2_idx = player_idx;
+    game->status = GAME_PLACING_SHIPS;
+    set_player_game(player_idx, game);
+    game_write_end(game);
+    notify_game(game);
+    
+    unlock(&game->mutex);
+    return REPLY_OK;
 }
 
-// Инициализация shared memory
-int init_shared_memory() {
-    // Пробуем открыть существующую shared memory
-    mmap_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-    if (mmap_fd < 0) {
-        // Если не получилось, создаем файл mmap
-        mmap_fd = open(MMAP_FILE, O_CREAT | O_RDWR, 0666);
-        if (mmap_fd < 0) {
-            perror("Failed to open mmap file");
-            return -1;
+int cmd_place_ship(int player_idx, const Command* cmd) {
+    int player_num;
+    Game* game = lock_player_game(player_idx, &player_num);
+    if (!game) {
+        return REPLY_NOT_AVAILABLE;
+    }
+    
+    // Размер корабля определяет сервер, клиент присылает только позицию
+    Fleet* fleet = &game->fleet[player_num - 1];
+    int size = fleet_next_ship_size(fleet);
+    ShipDirection dir = cmd->dir ? DIR_VERTICAL : DIR_HORIZONTAL;
+    
+    int status = REPLY_OK;
+    if (game->status != GAME_PLACING_SHIPS || size == 0) {
+        status = REPLY_BAD_STATE;
+    } else if (!can_place_ship(fleet, cmd->x, cmd->y, size, dir)) {
+        status = REPLY_CANNOT_PLACE;
+    } else {
+        game_write_begin(game, player_num - 1);
+        place_ship_on_board(fleet, cmd->x, cmd->y, size, dir);
+        
+        // Игра начинается, как только оба расставили флот
+        bool started = game->fleet[0].ships_count == TOTAL_SHIPS &&
+                       game->fleet[1].ships_count == TOTAL_SHIPS;
+        if (started) {
+            game->status = GAME_PLAYING;
+            game->current_turn = 1;  // Первый ход у создателя игры
+        }
+        game_write_end(game);
+        notify_game(game);
+        
+        if (started) {
+            printf("Game '%s' started!\n", game->name);
         }
     }
     
-    // Устанавливаем размер (увеличиваем для мьютекса)
-    if (ftruncate(mmap_fd, MMAP_SIZE) < 0) {
-        perror("ftruncate failed");
-        close(mmap_fd);
-        return -1;
+    unlock(&game->mutex);
+    return status;
+}
+
+int cmd_shot(int player_idx, const Command* cmd, Reply* reply) {
+    int player_num;
+    Game* game = lock_player_game(player_idx, &player_num);
+    if (!game) {
+        return REPLY_NOT_AVAILABLE;
     }
     
-    // Маппируем в память
-    shared = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, mmap_fd, 0);
-    if (shared == MAP_FAILED) {
-        perror("mmap failed");
-        close(mmap_fd);
-        return -1;
+    if (game->status != GAME_PLAYING) {
+        unlock(&game->mutex);
+        return REPLY_BAD_STATE;
+    }
+    if (game->current_turn != player_num) {
+        unlock(&game->mutex);
+        return REPLY_NOT_YOUR_TURN;
     }
     
-    // Инициализируем если первый запуск
-    if (shared->initialized != 12345) {
-        memset(shared, 0, sizeof(SharedData));
-        shared->player_count = 0;
-        shared->game_count = 0;
-        shared->initialized = 12345;
-        
-        // Инициализация мьютекса с атрибутами для shared memory
-        pthread_mutexattr_init(&shared->mutex_attr);
-        pthread_mutexattr_setpshared(&shared->mutex_attr, PTHREAD_PROCESS_SHARED);
-        pthread_mutexattr_setrobust(&shared->mutex_attr, PTHREAD_MUTEX_ROBUST);
-        pthread_mutex_init(&shared->mutex, &shared->mutex_attr);
-        
-        printf("Initialized new shared memory with POSIX mutex\n");
-    } else {
-        printf("Using existing shared memory\n");
-        
-        // Восстанавливаем мьютекс если он в неконсистентном состоянии
-        int ret = pthread_mutex_consistent(&shared->mutex);
-        if (ret == EINVAL) {
-            // Мьютекс не требует восстановления
-        } else if (ret != 0) {
-            fprintf(stderr, "Warning: mutex recovery failed: %s\n", strerror(ret));
+    game_write_begin(game, 2 - player_num);
+    int result = process_shot(game, player_num, cmd->x, cmd->y);
+    if (result < 0) {
+        game_write_end(game);
+        unlock(&game->mutex);
+        return result == -1 ? REPLY_BAD_COORDS : REPLY_ALREADY_SHOT;
+    }
+    
+    reply->shot_result = result;
+    game->last_move = time(NULL);
+    movelog_append(game, player_num, cmd->x, cmd->y, result);
+    
+    if (result == 0) {
+        game->current_turn = (player_num == 1) ? 2 : 1;
+    } else if (result == 2 && check_game_over(game, player_num) > 0) {
+        finish_game(game, player_num);
+    }
+    game_write_end(game);
+    
+    // Игрок мог уже выйти из игры, поэтому состояние берем здесь
+    reply->game_status = game->status;
+    reply->winner = game->winner;
+    
+    // Противник сразу перерисует доски
+    notify_game(game);
+    
+    unlock(&game->mutex);
+    return REPLY_OK;
+}
+
+// Выход из игры. Соперник, который еще в игре, побеждает: партия
+// завершается, и ждущие ее клиенты сразу видят итог. Игра без соперника
+// (ожидающая) закрывается без победителя. Слот в обоих случаях уходит
+// в очередь на освобождение
+int cmd_leave_game(int player_idx) {
+    int player_num;
+    Game* game = lock_player_game(player_idx, &player_num);
+    if (!game || game->status == GAME_FINISHED) {
+        set_player_game(player_idx, NULL);
+        if (game) {
+            unlock(&game->mutex);
         }
+        return REPLY_OK;
     }
     
-    return 0;
+    // Привязку соперника к игре меняют только под мьютексом игры
+    int other_idx = (player_num == 1) ? game->player2_idx : game->player1_idx;
+    Player* other = other_idx >= 0 ? get_player(other_idx) : NULL;
+    bool other_seated = other && other->game_id == game->id && other->game_gen == game->generation;
+    
+    game_write_begin(game, -1);
+    if (other_seated) {
+        printf("%s left game '%s'\n", get_player(player_idx)->login, game->name);
+        finish_game(game, 3 - player_num);
+    } else {
+        set_player_game(player_idx, NULL);
+        game->winner = 0;
+        __atomic_store_n(&game->status, GAME_FINISHED, __ATOMIC_RELEASE);
+        printf("Game '%s' closed\n", game->name);
+        schedule_reclaim(game);
+    }
+    game_write_end(game);
+    notify_game(game);
+    
+    unlock(&game->mutex);
+    return REPLY_OK;
 }
 
-// Поиск игрока по логину (без изменений)
-int find_player(const char* login) {
+uint64_t bot_seed(int player_idx) {
+    return ((uint64_t)time(NULL) << 20) ^ ((uint64_t)player_idx * 0x9E3779B97F4A7C15ull) ^ 1;
+}
+
+// Боты, оставшиеся в таблице игроков от прошлого запуска, снова в строю
+// (после восстановления статистики)
+int init_bots() {
+    bots = calloc(arena_player_limit(shared), sizeof(Bot));
+    if (!bots) {
+        perror("calloc failed");
+        return -1;
+    }
+    
     for (int i = 0; i < shared->player_count; i++) {
-        if (strcmp(shared->players[i].login, login) == 0) {
-            return i;
+        if (is_bot_login(get_player(i)->login)) {
+            set_player_online(i, true);
+            bots[bot_count++] = (Bot){ i, 0, bot_seed(i) };
         }
     }
-    return -1;
+    return 0;
 }
 
-// Добавление нового игрока (без изменений)
-int add_player(const char* login) {
-    int idx = find_player(login);
-    if (idx >= 0) {
-        // Игрок уже существует
-        shared->players[idx].online = true;
-        shared->players[idx].last_seen = time(NULL);
-        return idx;
+// Свободный бот, при необходимости регистрируется новый.
+// -1 если таблица игроков заполнена
+Bot* acquire_bot() {
+    for (int i = 0; i < bot_count; i++) {
+        if (get_player(bots[i].player_idx)->game_id < 0) {
+            return &bots[i];
+        }
     }
     
-    // Проверяем лимит
-    if (shared->player_count >= MAX_PLAYERS) {
-        return -1;
-    }
+    char login[MAX_LOGIN];
+    snprintf(login, sizeof(login), BOT_LOGIN_PREFIX "%d", bot_count + 1);
     
-    // Создаем нового игрока
-    Player* p = &shared->players[shared->player_count];
-    strncpy(p->login, login, MAX_LOGIN);
-    p->wins = 0;
-    p->losses = 0;
-    p->online = true;
-    p->game_id = -1;
-    p->last_seen = time(NULL);
-    p->ships_placed = false;
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    int idx = add_player(login);
+    unlock(&shared->players_mutex);
     
-    shared->player_count++;
-    return shared->player_count - 1;
+    if (idx < 0) {
+        return NULL;
+    }
+    bots[bot_count] = (Bot){ idx, 0, bot_seed(idx) };
+    return &bots[bot_count++];
 }
 
-// Поиск игры по имени (без изменений)
-int find_game(const char* name) {
-    for (int i = 0; i < shared->game_count; i++) {
-        if (strcmp(shared->games[i].name, name) == 0) {
-            return i;
+// Расстановка флота бота. Весь флот сначала раскладывается на копии через
+// can_place_ship/place_ship_on_board (случайная раскладка изредка заходит
+// в тупик - тогда начинаем заново), затем отправляется обычными командами
+void bot_place_fleet(Bot* bot, const Fleet* fleet) {
+    Fleet plan;
+    Command cmds[TOTAL_SHIPS];
+    int count;
+    
+    do {
+        plan = *fleet;
+        count = 0;
+        int size, tries = 0;
+        while ((size = fleet_next_ship_size(&plan)) > 0 && tries++ < 1000) {
+            int x = ai_random(&bot->rng) % BOARD_SIZE;
+            int y = ai_random(&bot->rng) % BOARD_SIZE;
+            ShipDirection dir = (ai_random(&bot->rng) & 1) ? DIR_VERTICAL : DIR_HORIZONTAL;
+            if (can_place_ship(&plan, x, y, size, dir)) {
+                place_ship_on_board(&plan, x, y, size, dir);
+                cmds[count++] = (Command){ .type = CMD_PLACE_SHIP, .x = x, .y = y, .dir = dir };
+            }
+        }
+    } while (plan.ships_count < TOTAL_SHIPS);
+    
+    for (int i = 0; i < count; i++) {
+        if (cmd_place_ship(bot->player_idx, &cmds[i]) != REPLY_OK) {
+            return;
         }
     }
-    return -1;
 }
 
-// Проверка возможности размещения корабля (без изменений)
-int can_place_ship(int board[BOARD_SIZE][BOARD_SIZE], int x, int y, int size, ShipDirection dir) {
-    // Проверка границ
-    if (dir == DIR_HORIZONTAL) {
-        if (x + size > BOARD_SIZE) return 0;
-    } else {
-        if (y + size > BOARD_SIZE) return 0;
+// Ответ бота на изменение его игры. Боты ходят, когда потоки пула
+// уже закончили, и игры больше никто в сервере не меняет, поэтому бот
+// читает игру без блокировки
+void bot_move(Bot* bot, Game* game) {
+    Player* p = get_player(bot->player_idx);
+    if (!game->in_use || game->generation != p->game_gen) {
+        set_player_game(bot->player_idx, NULL);
+        return;
     }
     
-    // Проверка всех клеток корабля и области вокруг
-    for (int i = 0; i < size; i++) {
-        int cx = (dir == DIR_HORIZONTAL) ? x + i : x;
-        int cy = (dir == DIR_VERTICAL) ? y + i : y;
-        
-        // Проверка самой клетки
-        if (board[cx][cy] != CELL_EMPTY) {
-            return 0;
+    int side = (game->player1_idx == bot->player_idx) ? 1 : 2;
+    int opponent = (side == 1) ? game->player2_idx : game->player1_idx;
+    
+    // Соперник вышел из игры - бот тоже уходит
+    if (opponent >= 0) {
+        Player* other = get_player(opponent);
+        if (other->game_id != game->id || other->game_gen != game->generation) {
+            cmd_leave_game(bot->player_idx);
+            return;
+        }
+    }
+    
+    if (game->status == GAME_PLACING_SHIPS &&
+        game->fleet[side - 1].ships_count < TOTAL_SHIPS) {
+        bot_place_fleet(bot, &game->fleet[side - 1]);
+    }
+    
+    // Попадание дает еще один ход
+    while (game->status == GAME_PLAYING && game->current_turn == side) {
+        int cell = ai_choose_shot(&game->fleet[2 - side], &bot->rng);
+        Command cmd = { .type = CMD_SHOT, .x = cell % BOARD_SIZE, .y = cell / BOARD_SIZE };
+        Reply reply;
+        memset(&reply, 0, sizeof(reply));
+        if (cell < 0 || cmd_shot(bot->player_idx, &cmd, &reply) != REPLY_OK) {
+            break;
+        }
+    }
+}
+
+// Ходы ботов: бот просыпается, только если его игра изменилась
+void run_bots() {
+    for (int i = 0; i < bot_count; i++) {
+        Bot* bot = &bots[i];
+        int game_id = get_player(bot->player_idx)->game_id;
+        if (game_id < 0) {
+            continue;
         }
         
-        // Проверка соседних клеток (включая диагонали)
-        for (int dx = -1; dx <= 1; dx++) {
-            for (int dy = -1; dy <= 1; dy++) {
-                int nx = cx + dx;
-                int ny = cy + dy;
-                
-                if (nx >= 0 && nx < BOARD_SIZE && ny >= 0 && ny < BOARD_SIZE) {
-                    if (board[nx][ny] == CELL_SHIP) {
-                        return 0;  // Корабль касается другого корабля
-                    }
-                }
-            }
+        Game* game = get_game(game_id);
+        if (__atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE) != bot->seen_seq) {
+            bot_move(bot, game);
+            bot->seen_seq = __atomic_load_n(&game->move_seq, __ATOMIC_ACQUIRE);
         }
     }
-    
-    return 1;  // Можно разместить
 }
 
-// Размещение корабля на доске (без изменений)
-void place_ship_on_board(int board[BOARD_SIZE][BOARD_SIZE], Ship* ship, 
-                         int x, int y, int size, ShipDirection dir) {
-    ship->size = size;
-    ship->hits = 0;
-    ship->sunk = false;
-    ship->start_x = x;
-    ship->start_y = y;
-    ship->dir = dir;
+// Бот садится вторым игроком в ожидающую игру. bots_mutex не дает
+// двум потокам выдать одного и того же свободного бота
+int attach_bot(int game_id) {
+    pthread_mutex_lock(&bots_mutex);
+    Bot* bot = acquire_bot();
+    if (!bot) {
+        pthread_mutex_unlock(&bots_mutex);
+        return REPLY_FULL;
+    }
     
-    // Занимаем клетки
-    for (int i = 0; i < size; i++) {
-        int cx = (dir == DIR_HORIZONTAL) ? x + i : x;
-        int cy = (dir == DIR_VERTICAL) ? y + i : y;
-        
-        board[cx][cy] = CELL_SHIP;
-        ship->cells[i][0] = cx;
-        ship->cells[i][1] = cy;
+    Command join = { .type = CMD_JOIN_GAME, .game_id = game_id };
+    int status = cmd_join_game(bot->player_idx, &join);
+    if (status == REPLY_OK) {
+        // Расстановка - в ближайшем run_bots
+        bot->seen_seq = __atomic_load_n(&get_game(game_id)->move_seq, __ATOMIC_ACQUIRE) - 1;
+        printf("Bot %s joined game %d\n", get_player(bot->player_idx)->login, game_id);
     }
+    pthread_mutex_unlock(&bots_mutex);
+    return status;
 }
 
-// Обработка выстрела (без изменений)
-int process_shot(Game* game, int player_num, int x, int y) {
-    // Определяем доску цели
-    int (*target_board)[BOARD_SIZE];
-    Ship* target_ships;
-    int* target_ships_count;
-    
-    if (player_num == 1) {
-        target_board = game->board2;
-        target_ships = game->ships2;
-        target_ships_count = &game->ships_count2;
-    } else {
-        target_board = game->board1;
-        target_ships = game->ships1;
-        target_ships_count = &game->ships_count1;
+// Бот в соперники для ожидающей игры (просит только ее создатель)
+int cmd_add_bot(int player_idx) {
+    Player* p = get_player(player_idx);
+    if (p->game_id < 0) {
+        return REPLY_NOT_AVAILABLE;
     }
     
-    // Проверяем координаты
-    if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
-        return -1;  // Неверные координаты
+    Game* game = get_game(p->game_id);
+    if (game->generation != p->game_gen || game->player1_idx != player_idx ||
+        game->status != GAME_WAITING) {
+        return REPLY_NOT_AVAILABLE;
+    }
+    return attach_bot(game->id);
+}
+
+// Выполнение одной команды канала
+void execute_command(Channel* ch, const Command* cmd, Reply* reply) {
+    memset(reply, 0, sizeof(*reply));
+    reply->tag = cmd->tag;
+    reply->type = cmd->type;
+    
+    int player_idx = ch->player_idx;
+    if (cmd->type != CMD_LOGIN && player_idx < 0) {
+        reply->status = REPLY_NOT_LOGGED_IN;
+        return;
     }
     
-    // Проверяем состояние клетки
-    if (target_board[x][y] == CELL_HIT || 
-        target_board[x][y] == CELL_MISS || 
-        target_board[x][y] == CELL_SUNK) {
-        return -2;  // Уже стреляли сюда
+    switch (cmd->type) {
+        case CMD_LOGIN:
+            reply->status = cmd_login(ch, cmd, reply);
+            break;
+        case CMD_CREATE_GAME:
+            reply->status = cmd_create_game(player_idx, cmd);
+            break;
+        case CMD_JOIN_GAME:
+            reply->status = cmd_join_game(player_idx, cmd);
+            break;
+        case CMD_PLACE_SHIP:
+            reply->status = cmd_place_ship(player_idx, cmd);
+            break;
+        case CMD_SHOT:
+            reply->status = cmd_shot(player_idx, cmd, reply);
+            break;
+        case CMD_LEAVE_GAME:
+            reply->status = cmd_leave_game(player_idx);
+            break;
+        case CMD_ADD_BOT:
+            reply->status = cmd_add_bot(player_idx);
+            break;
+        case CMD_LOGOUT:
+            set_player_online(player_idx, false);
+            ch->player_idx = -1;
+            break;
+        default:
+            reply->status = REPLY_UNKNOWN;
     }
     
-    // Обработка выстрела
-    if (target_board[x][y] == CELL_SHIP) {
-        target_board[x][y] = CELL_HIT;
+    if (reply->status == REPLY_OK && ch->player_idx >= 0) {
+        int8_t game_status = reply->game_status;
+        int8_t winner = reply->winner;
+        fill_reply(reply, ch->player_idx);
         
-        // Ищем корабль и увеличиваем счетчик попаданий
-        for (int s = 0; s < *target_ships_count; s++) {
-            for (int c = 0; c < target_ships[s].size; c++) {
-                if (target_ships[s].cells[c][0] == x && 
-                    target_ships[s].cells[c][1] == y) {
-                    target_ships[s].hits++;
-                    
-                    // Проверяем потопление
-                    if (target_ships[s].hits == target_ships[s].size) {
-                        target_ships[s].sunk = true;
-                        
-                        // Помечаем все клетки корабля как потопленные
-                        for (int i = 0; i < target_ships[s].size; i++) {
-                            int cx = target_ships[s].cells[i][0];
-                            int cy = target_ships[s].cells[i][1];
-                            target_board[cx][cy] = CELL_SUNK;
-                        }
-                        
-                        return 2;  // Корабль потоплен
-                    }
-                    
-                    return 1;  // Попадание
-                }
-            }
+        // После выстрела игрок уже отвязан от завершенной игры
+        if (cmd->type == CMD_SHOT) {
+            reply->game_status = game_status;
+            reply->winner = winner;
         }
-        return 1;
-    } else {
-        target_board[x][y] = CELL_MISS;
-        return 0;  // Промах
     }
 }
 
-// Проверка окончания игры (без изменений)
-int check_game_over(Game* game) {
-    // Проверяем все ли корабли первого игрока потоплены
-    int all_sunk1 = 1;
-    for (int i = 0; i < game->ships_count1; i++) {
-        if (!game->ships1[i].sunk) {
-            all_sunk1 = 0;
+// Выполнение всех команд канала и отправка ответов
+void process_channel(int idx) {
+    Channel* ch = arena_channel(shared, idx);
+    int replied = 0;
+    
+    while (1) {
+        uint32_t head = ch->cmd_head;
+        if (head == __atomic_load_n(&ch->cmd_tail, __ATOMIC_ACQUIRE)) {
             break;
         }
+        
+        // Клиент не забирает ответы - оставляем команды до следующего вызова
+        uint32_t reply_tail = ch->reply_tail;
+        if (reply_tail - __atomic_load_n(&ch->reply_head, __ATOMIC_ACQUIRE) >= CHANNEL_RING_SIZE) {
+            break;
+        }
+        
+        Command cmd = ch->commands[head % CHANNEL_RING_SIZE];
+        __atomic_store_n(&ch->cmd_head, head + 1, __ATOMIC_RELEASE);
+        
+        execute_command(ch, &cmd, &ch->replies[reply_tail % CHANNEL_RING_SIZE]);
+        __atomic_store_n(&ch->reply_tail, reply_tail + 1, __ATOMIC_RELEASE);
+        replied = 1;
     }
     
-    if (all_sunk1) {
-        game->winner = 2;
-        game->status = GAME_FINISHED;
-        return 2;
+    if (!replied) {
+        return;
     }
     
-    // Проверяем все ли корабли второго игрока потоплены
-    int all_sunk2 = 1;
-    for (int i = 0; i < game->ships_count2; i++) {
-        if (!game->ships2[i].sunk) {
-            all_sunk2 = 0;
-            break;
-        }
+    // Один системный вызов на все ответы канала. Шлюз ждет не на канале,
+    // а на change_seq, который сервер увеличивает в конце итерации
+    if (__atomic_load_n(&ch->batched, __ATOMIC_ACQUIRE)) {
+        uint64_t* ready = arena_at(shared, shared->ready_off);
+        __atomic_fetch_or(&ready[idx / 64], (uint64_t)1 << (idx % 64), __ATOMIC_RELEASE);
+    } else {
+        futex_wake(&ch->reply_tail, 1);
     }
+}
+
+// Обработка только тех каналов, в которые клиенты прислали команды.
+// Каналы выполняются пулом потоков; каждый канал за итерацию попадает
+// ровно к одному потоку, поэтому его кольца по-прежнему SPSC
+void process_pending_channels() {
+    uint64_t* pending = arena_at(shared, shared->pending_off);
+    int count = 0;
     
-    if (all_sunk2) {
-        game->winner = 1;
-        game->status = GAME_FINISHED;
-        return 1;
+    for (uint32_t w = 0; w < shared->pending_words; w++) {
+        uint64_t bits = __atomic_exchange_n(&pending[w], 0, __ATOMIC_ACQ_REL);
+        
+        while (bits) {
+            pending_tasks[count++] = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+        }
     }
     
-    return 0;  // Игра продолжается
+    workers_run(pending_tasks, count);
+}
+
+// Перенос буферов потоков в общие структуры (только основной поток)
+void merge_worker_logs() {
+    for (int w = 0; w < workers_count(); w++) {
+        WorkerLog* log = &worker_logs[w];
+        for (int i = 0; i < log->reclaim_count; i++) {
+            enqueue_reclaim(&log->reclaims[i]);
+        }
+        for (int i = 0; i < log->login_count; i++) {
+            presence_schedule(log->logins[i]);
+        }
+        log->reclaim_count = 0;
+        log->login_count = 0;
+    }
 }
 
-// Очистка неактивных игроков (без изменений)
-void cleanup_inactive_players() {
-    time_t now = time(NULL);
+// Число потоков пула: --workers или ядра, доступные процессу
+// (у шарда, привязанного к ядру, это одно ядро)
+int init_workers() {
+    int count = worker_count;
+    if (count <= 0) {
+        cpu_set_t set;
+        count = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : 1;
+    }
     
-    for (int i = 0; i < shared->player_count; i++) {
-        if (shared->players[i].online && (now - shared->players[i].last_seen) > 300) {
-            shared->players[i].online = false;
+    pending_tasks = malloc(shared->channel_count * sizeof(int));
+    worker_logs = calloc(count, sizeof(WorkerLog));
+    if (!pending_tasks || !worker_logs) {
+        perror("malloc failed");
+        return -1;
+    }
+    worker_log_count = count;
+    if (workers_start(count, shared->channel_count, process_channel) < 0) {
+        return -1;
+    }
+    
+    printf("Worker threads: %d\n", workers_count());
+    return 0;
+}
+
+// Освобождение буферов потоков (после workers_stop)
+void free_worker_logs() {
+    for (int w = 0; w < worker_log_count; w++) {
+        free(worker_logs[w].reclaims);
+        free(worker_logs[w].logins);
+    }
+    free(worker_logs);
+    free(pending_tasks);
+}
+
+// Освобождение каналов, владельцы которых завершились не попрощавшись
+void reap_dead_channels() {
+    for (uint32_t i = 0; i < shared->channel_count; i++) {
+        Channel* ch = arena_channel(shared, i);
+        pid_t pid = __atomic_load_n(&ch->owner_pid, __ATOMIC_ACQUIRE);
+        if (pid == 0 || kill(pid, 0) == 0 || errno != ESRCH) {
+            continue;
         }
+        
+        // Игрок умершего клиента проигрывает свою партию
+        if (ch->player_idx >= 0) {
+            cmd_leave_game(ch->player_idx);
+            set_player_online(ch->player_idx, false);
+        }
+        
+        ch->player_idx = -1;
+        ch->matching = MATCH_IDLE;
+        ch->batched = 0;
+        ch->cmd_head = ch->cmd_tail;
+        ch->reply_head = ch->reply_tail;
+        __atomic_store_n(&ch->owner_pid, 0, __ATOMIC_RELEASE);
     }
 }
 
-// Вывод статуса сервера (без изменений)
-void print_server_status() {
-    printf("\n=== Server Status ===\n");
-    printf("Players: %d/%d (online: ", shared->player_count, MAX_PLAYERS);
+int init_matchmaking() {
+    match_waiters = malloc(arena_player_limit(shared) * sizeof(MatchWaiter));
+    match_queued = calloc(arena_player_limit(shared), sizeof(bool));
+    if (!match_waiters || !match_queued) {
+        perror("malloc failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Перенос новых заявок из очереди подбора в список ждущих
+void drain_match_queue() {
+    MatchTicket ticket;
+    while (match_dequeue(shared, &ticket)) {
+        int idx = ticket.player_idx;
+        if (idx < 0 || idx >= shared->player_count || match_queued[idx] ||
+            ticket.channel < 0 || (uint32_t)ticket.channel >= shared->channel_count) {
+            continue;
+        }
+        
+        match_queued[idx] = true;
+        match_waiters[match_waiting++] = (MatchWaiter){ idx, ticket.channel, ticket.rating, 0 };
+    }
+}
+
+// Заявка действует, пока клиент ждет, а игрок в сети и не в игре
+bool match_valid(const MatchWaiter* w) {
+    Channel* ch = arena_channel(shared, w->channel);
+    Player* p = get_player(w->player_idx);
+    return ch->player_idx == w->player_idx && p->online && p->game_id < 0 &&
+           __atomic_load_n(&ch->matching, __ATOMIC_ACQUIRE) == MATCH_SEARCHING;
+}
+
+int compare_waiters(const void* a, const void* b) {
+    return ((const MatchWaiter*)a)->rating - ((const MatchWaiter*)b)->rating;
+}
+
+// Клиент забирается CAS, чтобы не разминуться с его отменой по таймауту
+bool claim_waiter(const MatchWaiter* w) {
+    uint32_t expected = MATCH_SEARCHING;
+    return __atomic_compare_exchange_n(&arena_channel(shared, w->channel)->matching,
+                                       &expected, MATCH_CLAIMED, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Итог подбора для клиента: получил игру - будим его, иначе он ждет дальше
+void release_waiter(const MatchWaiter* w) {
+    Channel* ch = arena_channel(shared, w->channel);
+    if (get_player(w->player_idx)->game_id < 0) {
+        __atomic_store_n(&ch->matching, MATCH_SEARCHING, __ATOMIC_RELEASE);
+        return;
+    }
     
-    int online = 0;
-    for (int i = 0; i < shared->player_count; i++) {
-        if (shared->players[i].online) online++;
+    __atomic_store_n(&ch->matching, MATCH_IDLE, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&ch->match_seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&ch->match_seq, 1);
+}
+
+// Игра подбора от имени игрока. Имя должно быть уникальным:
+// при совпадении берем следующий номер
+int create_match_game(int player_idx) {
+    Command create = { .type = CMD_CREATE_GAME };
+    int status;
+    do {
+        snprintf(create.name, MAX_NAME, "match-%u", ++match_games);
+        status = cmd_create_game(player_idx, &create);
+    } while (status == REPLY_NAME_TAKEN);
+    return status;
+}
+
+// Игра с ботом для того, кому долго нет пары
+int start_bot_match(const MatchWaiter* a) {
+    if (!claim_waiter(a)) {
+        return -1;
     }
-    printf("%d)\n", online);
     
-    printf("Games: %d/%d\n", shared->game_count, MAX_GAMES);
+    int status = create_match_game(a->player_idx);
+    if (status == REPLY_OK) {
+        status = attach_bot(get_player(a->player_idx)->game_id);
+    }
     
-    // Статистика по играм
-    int waiting = 0, placing = 0, playing = 0, finished = 0;
-    for (int i = 0; i < shared->game_count; i++) {
-        switch (shared->games[i].status) {
-            case GAME_WAITING: waiting++; break;
-            case GAME_PLACING_SHIPS: placing++; break;
-            case GAME_PLAYING: playing++; break;
-            case GAME_FINISHED: finished++; break;
-        }
+    // Если бот не нашелся, игрок все равно получает игру и ждет в ней
+    release_waiter(a);
+    return get_player(a->player_idx)->game_id >= 0 ? 0 : -1;
+}
+
+// Игра для пары: создает первый игрок, сразу присоединяется второй.
+// Возвращает 0, если оба игрока получили игру
+int start_match(const MatchWaiter* a, const MatchWaiter* b) {
+    if (!claim_waiter(a)) {
+        return -1;
+    }
+    if (!claim_waiter(b)) {
+        release_waiter(a);
+        return -1;
     }
     
-    printf("Games status: waiting=%d, placing=%d, playing=%d, finished=%d\n",
-           waiting, placing, playing, finished);
+    int status = create_match_game(a->player_idx);
+    if (status == REPLY_OK) {
+        Command join = { .type = CMD_JOIN_GAME, .game_id = get_player(a->player_idx)->game_id };
+        status = cmd_join_game(b->player_idx, &join);
+    }
+    
+    release_waiter(a);
+    release_waiter(b);
+    return status == REPLY_OK ? 0 : -1;
+}
+
+// Раунд подбора: ждущие сортируются по рейтингу, соседи объединяются,
+// если разница рейтингов укладывается в полосу. Полоса пары растет с
+// каждым раундом, который прождал каждый из двоих, поэтому никто не ждет вечно.
+// Кто прождал MATCH_BOT_ROUNDS раундов без пары, играет с ботом
+void match_players() {
+    int count = 0;
+    for (int i = 0; i < match_waiting; i++) {
+        if (match_valid(&match_waiters[i])) {
+            match_waiters[count++] = match_waiters[i];
+        } else {
+            match_queued[match_waiters[i].player_idx] = false;
+        }
+    }
+    qsort(match_waiters, count, sizeof(MatchWaiter), compare_waiters);
     
-    if (shared->player_count > 0) {
-        printf("Recent players:\n");
-        for (int i = 0; i < shared->player_count && i < 5; i++) {
-            printf("  %s: %dW/%dL %s\n", 
-                   shared->players[i].login, 
-                   shared->players[i].wins, 
-                   shared->players[i].losses,
-                   shared->players[i].online ? "online" : "offline");
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        MatchWaiter* a = &match_waiters[i];
+        if (i + 1 < count) {
+            MatchWaiter* b = &match_waiters[i + 1];
+            int rounds = a->rounds < b->rounds ? a->rounds : b->rounds;
+            if (b->rating - a->rating <= MATCH_BAND_WIDTH * (1 + rounds) &&
+                start_match(a, b) == 0) {
+                match_queued[a->player_idx] = false;
+                match_queued[b->player_idx] = false;
+                i++;
+                continue;
+            }
+        }
+        
+        if (a->rounds >= MATCH_BOT_ROUNDS && start_bot_match(a) == 0) {
+            match_queued[a->player_idx] = false;
+            continue;
         }
+        
+        a->rounds++;
+        match_waiters[kept++] = *a;
     }
+    match_waiting = kept;
+}
+
+// Ожидание событий от клиентов не дольше timeout_sec секунд
+void wait_for_events(uint32_t seen_seq, time_t timeout_sec) {
+    if (timeout_sec <= 0 || !running) {
+        return;
+    }
+    
+    struct timespec timeout = { timeout_sec, 0 };
+    
+    __atomic_store_n(&shared->server_sleeping, 1, __ATOMIC_SEQ_CST);
+    // Если event_seq уже изменился, futex_wait сразу вернет EAGAIN
+    futex_wait(&shared->event_seq, seen_seq, &timeout);
+    __atomic_store_n(&shared->server_sleeping, 0, __ATOMIC_SEQ_CST);
 }
 
 // Основной цикл сервера
@@ -360,73 +1721,104 @@ void server_loop() {
     // printf("Synchronization: POSIX mutex (process-shared)\n");
     // printf("Press Ctrl+C to stop\n");
     
-    int iteration = 0;
+    time_t next_tick = 0;
     
     while (running) {
-        lock();
-        
-        cleanup_inactive_players();
-        
-        // Показываем статус каждые 10 секунд
-        if (iteration % 20 == 0) {
-            print_server_status();
-        }
+        // Запоминаем номер события до обработки, чтобы не потерять пробуждение
+        uint32_t seq = __atomic_load_n(&shared->event_seq, __ATOMIC_ACQUIRE);
         
-        // Проверяем игры на окончание
-        for (int i = 0; i < shared->game_count; i++) {
-            Game* game = &shared->games[i];
-            
-            if (game->status == GAME_PLAYING) {
-                int result = check_game_over(game);
-                if (result > 0) {
-                    // Обновляем статистику игроков
-                    int p1 = find_player(game->player1);
-                    int p2 = find_player(game->player2);
-                    
-                    if (result == 1) {
-                        if (p1 >= 0) shared->players[p1].wins++;
-                        if (p2 >= 0) shared->players[p2].losses++;
-                    } else {
-                        if (p2 >= 0) shared->players[p2].wins++;
-                        if (p1 >= 0) shared->players[p1].losses++;
-                    }
-                    
-                    // Освобождаем игроков
-                    if (p1 >= 0) shared->players[p1].game_id = -1;
-                    if (p2 >= 0) shared->players[p2].game_id = -1;
-                    
-                    printf("Game '%s' finished. Winner: %s\n", 
-                           game->name, 
-                           result == 1 ? game->player1 : game->player2);
-                }
+        // Периодические задачи раз в SERVER_TICK_SEC секунд
+        time_t now = time(NULL);
+        if (now >= next_tick) {
+            cleanup_inactive_players(now);
+            record_page_faults();
+            if (stats_need_compaction()) {
+                lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+                compact_stats();
+                unlock(&shared->players_mutex);
             }
+            reap_dead_channels();
             
-            // Проверяем готовность к началу игры
-            if (game->status == GAME_PLACING_SHIPS) {
-                if (game->ships_count1 == TOTAL_SHIPS && 
-                    game->ships_count2 == TOTAL_SHIPS) {
-                    game->status = GAME_PLAYING;
-                    game->current_turn = 1;  // Первый ход у создателя игры
-                    printf("Game '%s' started!\n", game->name);
-                }
-            }
+            next_tick = now + SERVER_TICK_SEC;
+        }
+        
+        // Команды клиентов выполняют потоки пула; каждая игра блокируется отдельно
+        process_pending_channels();
+        
+        // Новые заявки сразу переходят в список ждущих, а пары
+        // составляются пачкой раз в MATCH_ROUND_SEC
+        drain_match_queue();
+        if (match_waiting > 0 && now >= next_match_round) {
+            match_players();
+            next_match_round = now + MATCH_ROUND_SEC;
         }
         
-        unlock();
+        // Боты отвечают на ходы, сделанные в этой итерации
+        run_bots();
+        
+        // Освобождения игр и логины, накопленные потоками
+        merge_worker_logs();
+        
+        // Одно пробуждение шлюзов на все ответы и ходы итерации
+        publish_changes(shared);
+        
+        time_t wake_at = next_tick;
+        if (match_waiting > 0 && next_match_round < wake_at) {
+            wake_at = next_match_round;
+        }
+        time_t next_reclaim = reclaim_finished_games(now);
+        if (next_reclaim > 0 && next_reclaim < wake_at) {
+            wake_at = next_reclaim;
+        }
         
-        usleep(500000);  // 500ms
-        iteration++;
+        wait_for_events(seq, wake_at - now);
+    }
+}
+
+// Состояние сохранено: клиенты, ждущие ответа, хода или соперника,
+// просыпаются, видят SHM_RETIRED и переходят на сегмент следующего запуска
+void retire_segment() {
+    __atomic_store_n(&shared->initialized, SHM_RETIRED, __ATOMIC_SEQ_CST);
+    
+    for (uint32_t i = 0; i < shared->channel_count; i++) {
+        Channel* ch = arena_channel(shared, i);
+        if (__atomic_load_n(&ch->owner_pid, __ATOMIC_RELAXED) != 0) {
+            futex_wake(&ch->reply_tail, INT_MAX);
+            futex_wake(&ch->match_seq, INT_MAX);
+        }
+    }
+    for (int i = 0; i < arena_game_capacity(shared); i++) {
+        Game* game = get_game(i);
+        lock(&game->mutex, LOCK_SERVER_SNAPSHOT);
+        notify_game(game);
+        unlock(&game->mutex);
     }
+    publish_changes(shared);
 }
 
 // Основная функция
-int main() {
+int main(int argc, char* argv[]) {
+    if (parse_config(argc, argv) < 0) {
+        return 1;
+    }
+    
+    if (stats_mode) {
+        return run_stats_mode();
+    }
+    
     printf("=== Sea Battle Server ===\n");
     printf("Using MMAP for inter-process communication\n");
     
     // Настройка обработчиков сигналов
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    setup_signals();
+    
+    // Данные под мьютексами упавшего процесса чинятся при первом захвате
+    locks_on_owner_death(on_owner_death);
+    
+    if (init_shard() < 0) {
+        fprintf(stderr, "Failed to join the shard directory\n");
+        return 1;
+    }
     
     // Инициализация shared memory
     if (init_shared_memory() < 0) {
@@ -434,27 +1826,72 @@ int main() {
         return 1;
     }
     
+    locks_init(shared);
+    
+    if (init_presence() < 0 || init_matchmaking() < 0) {
+        return 1;
+    }
+    
+    if (init_stats_store() < 0) {
+        fprintf(stderr, "Failed to open player statistics store\n");
+        return 1;
+    }
+    
+    if (init_bots() < 0 || init_workers() < 0) {
+        return 1;
+    }
+    
+    // Дальнейшие ошибки страниц - уже во время работы
+    record_page_faults();
+    shared->setup_minflt = shared->server_minflt;
+    
     // Запуск основного цикла
     server_loop();
+    workers_stop();
+    free_worker_logs();
+    
+    // Итоговый снимок статистики и запись хвоста журнала
+    lock(&shared->players_mutex, LOCK_SERVER_PLAYERS);
+    compact_stats();
+    unlock(&shared->players_mutex);
+    stats_close();
+    
+    // Игры и игроки - в снимок для следующего запуска
+    if (state_save(&arena, stats_dir) == 0) {
+        printf("Server state saved to %s/%s\n", stats_dir, STATE_SNAPSHOT_FILE);
+        retire_segment();
+    }
     
     // Очистка при завершении
     printf("\nCleaning up...\n");
     
-    // Уничтожаем мьютекс
+    // Уничтожаем мьютексы
+    for (int i = 0; i < arena_game_capacity(shared); i++) {
+        pthread_mutex_destroy(&get_game(i)->mutex);
+    }
+    pthread_mutex_destroy(&shared->arena_mutex);
+    pthread_mutex_destroy(&shared->players_mutex);
     pthread_mutex_destroy(&shared->mutex);
     pthread_mutexattr_destroy(&shared->mutex_attr);
     
-    if (shared) {
-        munmap(shared, MMAP_SIZE);
-    }
+    arena_detach(&arena);
+    free(reclaim_queue);
     
     if (mmap_fd >= 0) {
         close(mmap_fd);
     }
     
-    // Удаляем shared memory объекты
-    shm_unlink(SHM_NAME);
-    remove(MMAP_FILE);
+    // Удаляем shared memory объекты (и файл hugetlbfs за ссылкой)
+    char name[PATH_MAX];
+    shard_shm_name(name, sizeof(name), shard_index, shard_total);
+    shm_unlink(name);
+    shard_mmap_file(name, sizeof(name), shard_index, shard_total);
+    huge_segment_unlink(name);
+    
+    if (directory) {
+        directory_unregister_shard(directory, shard_index);
+        directory_close(directory);
+    }
     
     printf("Server stopped.\n");
     return 0;
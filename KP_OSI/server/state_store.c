@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include "../shared/events.h"
+#include "../shared/index.h"
+#include "../shared/locks.h"
+#include "../shared/seqlock.h"
+#include "state_store.h"
+
+#define STATE_MAGIC 0x53425354u   // "SBST"
+#define STATE_VERSION 1
+
+// Игрок в снимке. Индекс игрока - номер записи
+typedef struct {
+    char login[MAX_LOGIN];
+    uint8_t online;
+    uint8_t ships_placed;
+    int32_t game_id;
+    uint32_t game_gen;
+} StatePlayer;
+
+// Занятая игра: все, что нужно, чтобы продолжить партию
+typedef struct {
+    int32_t id;
+    uint32_t generation;
+    char name[MAX_NAME];
+    char player1[MAX_LOGIN];
+    char player2[MAX_LOGIN];
+    int32_t player1_idx;
+    int32_t player2_idx;
+    int32_t status;
+    int32_t current_turn;
+    int32_t winner;
+    int64_t last_move;
+    uint32_t move_count;
+    Fleet fleet[2];
+    GameMove moves[MOVE_LOG_SIZE];
+} StateGame;
+
+// Заголовок снимка, за ним player_count записей StatePlayer
+// и game_count записей StateGame
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t player_size;   // Размеры записей: снимок сборки
+    uint32_t game_size;     // с другой раскладкой не читается
+    uint32_t epoch;         // Запуск сервера, записавший снимок
+    uint32_t player_count;
+    uint32_t game_count;
+    uint32_t checksum;      // FNV-1a всех записей
+} StateHeader;
+
+static uint32_t checksum(uint32_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t records_checksum(const StateHeader* header, const StatePlayer* players,
+                                 const StateGame* games) {
+    uint32_t hash = checksum(2166136261u, players, header->player_count * sizeof(StatePlayer));
+    return checksum(hash, games, header->game_count * sizeof(StateGame));
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0) {
+            perror("state write failed");
+            return -1;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Копия игры (под ее мьютексом)
+static void save_game(StateGame* g, const Game* game) {
+    g->id = game->id;
+    g->generation = game->generation;
+    memcpy(g->name, game->name, MAX_NAME);
+    memcpy(g->player1, game->player1, MAX_LOGIN);
+    memcpy(g->player2, game->player2, MAX_LOGIN);
+    g->player1_idx = game->player1_idx;
+    g->player2_idx = game->player2_idx;
+    g->status = game->status;
+    g->current_turn = game->current_turn;
+    g->winner = game->winner;
+    g->last_move = game->last_move;
+    g->move_count = game->move_count;
+    memcpy(g->fleet, game->fleet, sizeof(g->fleet));
+    memcpy(g->moves, game->moves, sizeof(g->moves));
+}
+
+// Снимок пишется во временный файл и атомарно подменяет старый
+static int write_state(const char* dir, const StateHeader* header,
+                       const StatePlayer* players, const StateGame* games) {
+    char path[PATH_MAX], tmp_path[PATH_MAX + 4];
+    snprintf(path, sizeof(path), "%s/%s", dir, STATE_SNAPSHOT_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    int fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror("Failed to create state snapshot");
+        return -1;
+    }
+    
+    if (write_all(fd, header, sizeof(*header)) < 0 ||
+        write_all(fd, players, header->player_count * sizeof(StatePlayer)) < 0 ||
+        write_all(fd, games, header->game_count * sizeof(StateGame)) < 0 ||
+        fsync(fd) < 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    
+    if (rename(tmp_path, path) < 0) {
+        perror("Failed to replace state snapshot");
+        return -1;
+    }
+    
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+int state_save(ShmArena* arena, const char* dir) {
+    SharedData* shared = arena->shared;
+    StateHeader header = { STATE_MAGIC, STATE_VERSION, sizeof(StatePlayer), sizeof(StateGame),
+                           shared->epoch, 0, 0, 0 };
+    
+    // Порядок захвата обычный: список игр, игра, таблица игроков
+    lock(&shared->mutex, LOCK_SERVER_SNAPSHOT);
+    
+    int game_count = shared->game_count;
+    StateGame* games = calloc(game_count + 1, sizeof(StateGame));
+    for (int id = 0; games && id < game_count; id++) {
+        Game* game = arena_game(arena, id);
+        lock(&game->mutex, LOCK_SERVER_SNAPSHOT);
+        if (game->in_use) {
+            save_game(&games[header.game_count++], game);
+        }
+        unlock(&game->mutex);
+    }
+    
+    lock(&shared->players_mutex, LOCK_SERVER_SNAPSHOT);
+    header.player_count = shared->player_count;
+    StatePlayer* players = calloc(header.player_count + 1, sizeof(StatePlayer));
+    for (uint32_t i = 0; players && i < header.player_count; i++) {
+        Player* p = arena_player(arena, i);
+        memcpy(players[i].login, p->login, MAX_LOGIN);
+        players[i].online = p->online;
+        players[i].ships_placed = p->ships_placed;
+        players[i].game_id = p->game_id;
+        players[i].game_gen = p->game_gen;
+    }
+    unlock(&shared->players_mutex);
+    
+    unlock(&shared->mutex);
+    
+    int ret = -1;
+    if (games && players) {
+        header.checksum = records_checksum(&header, players, games);
+        ret = write_state(dir, &header, players, games);
+    } else {
+        fprintf(stderr, "Failed to save server state (out of memory)\n");
+    }
+    
+    free(games);
+    free(players);
+    return ret;
+}
+
+// Снимок должен поместиться в сегмент целиком: игроки и игры
+// ссылаются друг на друга по индексам
+static bool state_fits(SharedData* shared, const StateHeader* header,
+                       StatePlayer* players, StateGame* games) {
+    int player_count = header->player_count;
+    if (player_count > arena_player_limit(shared)) {
+        return false;
+    }
+    
+    for (int i = 0; i < player_count; i++) {
+        players[i].login[MAX_LOGIN - 1] = '\0';
+        if (players[i].game_id >= arena_game_limit(shared)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->game_count; i++) {
+        StateGame* g = &games[i];
+        g->name[MAX_NAME - 1] = '\0';
+        g->player1[MAX_LOGIN - 1] = '\0';
+        g->player2[MAX_LOGIN - 1] = '\0';
+        if (g->id < 0 || g->id >= arena_game_limit(shared) ||
+            g->player1_idx < -1 || g->player1_idx >= player_count ||
+            g->player2_idx < -1 || g->player2_idx >= player_count ||
+            g->move_count > MOVE_LOG_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Игра встает в свой прежний слот (под mutex)
+static void restore_game(Game* game, const StateGame* g) {
+    lock(&game->mutex, LOCK_SERVER_SNAPSHOT);
+    seqlock_write_begin(&game->seq);
+    
+    game->id = g->id;
+    game->generation = g->generation;
+    game->in_use = true;
+    strcpy(game->name, g->name);
+    game->name_hash = hash_string(game->name);
+    strcpy(game->player1, g->player1);
+    strcpy(game->player2, g->player2);
+    game->player1_idx = g->player1_idx;
+    game->player2_idx = g->player2_idx;
+    game->status = g->status;
+    game->current_turn = g->current_turn;
+    game->winner = g->winner;
+    game->last_move = g->last_move;
+    memcpy(game->fleet, g->fleet, sizeof(game->fleet));
+    memcpy(game->moves, g->moves, sizeof(game->moves));
+    __atomic_store_n(&game->move_count, g->move_count, __ATOMIC_RELEASE);
+    
+    seqlock_write_end(&game->seq);
+    
+    // move_seq отличается от нуля: боты сервера заметят свою игру
+    notify_game(game);
+    unlock(&game->mutex);
+}
+
+static int restore_state(ShmArena* arena, const StateHeader* header,
+                         const StatePlayer* players, const StateGame* games) {
+    SharedData* shared = arena->shared;
+    time_t now = time(NULL);
+    int ret = 1;
+    
+    lock(&shared->mutex, LOCK_SERVER_SNAPSHOT);
+    
+    int game_count = 0;
+    for (uint32_t i = 0; i < header->game_count; i++) {
+        if (games[i].id >= game_count) {
+            game_count = games[i].id + 1;
+        }
+    }
+    if (arena_reserve_games(arena, game_count) < 0) {
+        unlock(&shared->mutex);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < header->game_count; i++) {
+        restore_game(arena_game(arena, games[i].id), &games[i]);
+    }
+    
+    // Свободные слоты, массив живых игр и индекс - по флагам in_use
+    arena_rebuild_games(arena);
+    index_rebuild_games(arena);
+    
+    // Отметка активности от момента загрузки: игрок, который так и не
+    // вернулся, уйдет по обычному таймауту присутствия
+    lock(&shared->players_mutex, LOCK_SERVER_SNAPSHOT);
+    for (uint32_t i = 0; i < header->player_count; i++) {
+        if ((int)i >= arena_player_capacity(shared) && arena_add_player_chunk(arena) < 0) {
+            ret = -1;
+            break;
+        }
+        
+        Player* p = arena_player(arena, i);
+        seqlock_write_begin(&p->seq);
+        strcpy(p->login, players[i].login);
+        p->login_hash = hash_string(p->login);
+        p->online = players[i].online;
+        p->ships_placed = players[i].ships_placed;
+        p->game_id = players[i].game_id;
+        p->game_gen = players[i].game_gen;
+        p->last_seen = now;
+        seqlock_write_end(&p->seq);
+        
+        index_insert_player(arena, i);
+        __atomic_store_n(&shared->player_count, i + 1, __ATOMIC_RELEASE);
+    }
+    unlock(&shared->players_mutex);
+    
+    unlock(&shared->mutex);
+    
+    __atomic_store_n(&shared->epoch, header->epoch + 1, __ATOMIC_RELEASE);
+    return ret;
+}
+
+int state_load(ShmArena* arena, const char* dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, STATE_SNAPSHOT_FILE);
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    StateHeader header;
+    StatePlayer* players = NULL;
+    StateGame* games = NULL;
+    int ret = 0;
+    
+    if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != STATE_MAGIC || header.version != STATE_VERSION ||
+        header.player_size != sizeof(StatePlayer) || header.game_size != sizeof(StateGame)) {
+        fprintf(stderr, "Warning: server state snapshot has an unknown format, ignoring it\n");
+    } else {
+        size_t players_size = (size_t)header.player_count * sizeof(StatePlayer);
+        size_t games_size = (size_t)header.game_count * sizeof(StateGame);
+        players = malloc(players_size + 1);
+        games = malloc(games_size + 1);
+        
+        if (!players || !games ||
+            read(fd, players, players_size) != (ssize_t)players_size ||
+            read(fd, games, games_size) != (ssize_t)games_size ||
+            records_checksum(&header, players, games) != header.checksum) {
+            fprintf(stderr, "Warning: server state snapshot is damaged, ignoring it\n");
+        } else if (!state_fits(arena->shared, &header, players, games)) {
+            fprintf(stderr, "Warning: server state snapshot does not fit the configured capacity, "
+                            "ignoring it\n");
+        } else {
+            ret = restore_state(arena, &header, players, games);
+        }
+    }
+    
+    close(fd);
+    free(players);
+    free(games);
+    
+    // Снимок загружается один раз: дальше свежее уже сам сегмент
+    if (ret == 1) {
+        unlink(path);
+    }
+    return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include "../shared/protocol.h"
+#include "../shared/arena.h"
+
+// Снимок состояния сервера в каталоге статистики
+#define STATE_SNAPSHOT_FILE "sea_battle_state.snap"
+
+// Снимок игроков и занятых игр сегмента. Игры копируются под mutex и
+// мьютексом каждой игры, игроки - под players_mutex, поэтому снимок
+// согласован, если потоки пула уже остановлены. Файл подменяется атомарно
+int state_save(ShmArena* arena, const char* dir);
+
+// Загрузка снимка в только что созданный сегмент. Игроки встают на прежние
+// индексы, игры - в прежние слоты с прежними поколениями, поэтому клиенты
+// находят свои игры по старым id. Победы и поражения в снимок не входят:
+// их восстанавливает хранилище статистики. Загруженный снимок удаляется.
+// Возвращает 1, если состояние восстановлено, 0 если снимка нет
+// или он не подходит, -1 при ошибке
+int state_load(ShmArena* arena, const char* dir);
+
+#endif // STATE_STORE_H
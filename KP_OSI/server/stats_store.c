@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "stats_store.h"
+
+#define STATS_MAGIC 0x53424154u   // "SBAT"
+#define STATS_VERSION 1
+
+// Запись журнала: результат одной игры
+typedef struct {
+    uint32_t checksum;      // FNV-1a всех полей после checksum
+    uint32_t reserved;
+    uint64_t seq;           // Номер записи, растет без пропусков
+    char winner[MAX_LOGIN];
+    char loser[MAX_LOGIN];
+} StatsRecord;
+
+// Заголовок снимка, за ним count строк StatsEntry
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t last_seq;      // Снимок учитывает все записи журнала до этой
+    uint32_t count;
+    uint32_t checksum;      // FNV-1a строк снимка
+} SnapshotHeader;
+
+static char wal_path[PATH_MAX];
+static char snapshot_path[PATH_MAX];
+static char dir_path[PATH_MAX];
+static int wal_fd = -1;
+
+// Состояние, общее с потоком записи (под store_mutex)
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t store_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static StatsRecord* pending = NULL;     // Записи, еще не отданные на диск
+static int pending_len = 0;
+static int pending_cap = 0;
+static StatsEntry* compact_entries = NULL;  // Запрошенный снимок
+static int compact_count = 0;
+static uint64_t compact_seq = 0;
+static uint64_t next_seq = 1;
+static int wal_records = 0;             // Записей в журнале после снимка
+static bool stopping = false;
+
+static uint32_t checksum(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const StatsRecord* record) {
+    return checksum((const char*)record + sizeof(record->checksum),
+                    sizeof(*record) - sizeof(record->checksum));
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0) {
+            perror("stats write failed");
+            return -1;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Чтение снимка. Возвращает номер последней учтенной записи журнала
+static uint64_t load_snapshot(StatsApplyFn apply) {
+    int fd = open(snapshot_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    SnapshotHeader header;
+    StatsEntry* entries = NULL;
+    uint64_t last_seq = 0;
+    
+    if (read(fd, &header, sizeof(header)) == sizeof(header) &&
+        header.magic == STATS_MAGIC && header.version == STATS_VERSION) {
+        size_t size = (size_t)header.count * sizeof(StatsEntry);
+        entries = malloc(size ? size : 1);
+        
+        if (entries && read(fd, entries, size) == (ssize_t)size &&
+            checksum(entries, size) == header.checksum) {
+            for (uint32_t i = 0; apply && i < header.count; i++) {
+                entries[i].login[MAX_LOGIN - 1] = '\0';
+                apply(entries[i].login, entries[i].wins, entries[i].losses);
+            }
+            last_seq = header.last_seq;
+        } else {
+            fprintf(stderr, "Warning: stats snapshot is damaged, ignoring it\n");
+        }
+    }
+    
+    free(entries);
+    close(fd);
+    return last_seq;
+}
+
+// Проигрывание журнала после снимка. Хвост после первой
+// поврежденной записи (оборванная запись при падении) обрезается
+static int replay_wal(uint64_t last_seq, StatsApplyFn apply) {
+    StatsRecord record;
+    off_t good = 0;
+    
+    next_seq = last_seq + 1;
+    
+    while (read(wal_fd, &record, sizeof(record)) == sizeof(record) &&
+           record.checksum == record_checksum(&record)) {
+        good += sizeof(record);
+        wal_records++;
+        
+        if (record.seq <= last_seq) {
+            continue;  // Уже учтена в снимке
+        }
+        
+        if (apply) {
+            record.winner[MAX_LOGIN - 1] = '\0';
+            record.loser[MAX_LOGIN - 1] = '\0';
+            if (record.winner[0]) apply(record.winner, 1, 0);
+            if (record.loser[0]) apply(record.loser, 0, 1);
+        }
+        next_seq = record.seq + 1;
+    }
+    
+    if (ftruncate(wal_fd, good) < 0) {
+        perror("ftruncate stats log failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Снимок пишется во временный файл и атомарно подменяет старый
+static int write_snapshot(StatsEntry* entries, int count, uint64_t last_seq) {
+    char tmp_path[PATH_MAX + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", snapshot_path);
+    
+    int fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror("Failed to create stats snapshot");
+        return -1;
+    }
+    
+    SnapshotHeader header = { STATS_MAGIC, STATS_VERSION, last_seq, count,
+                              checksum(entries, (size_t)count * sizeof(StatsEntry)) };
+    
+    if (write_all(fd, &header, sizeof(header)) < 0 ||
+        write_all(fd, entries, (size_t)count * sizeof(StatsEntry)) < 0 ||
+        fsync(fd) < 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    
+    if (rename(tmp_path, snapshot_path) < 0) {
+        perror("Failed to replace stats snapshot");
+        return -1;
+    }
+    
+    // Делаем переименование устойчивым
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+// Записи в конец журнала и на диск
+static void append_records(const StatsRecord* records, int count) {
+    if (count > 0 && write_all(wal_fd, records, count * sizeof(StatsRecord)) == 0 &&
+        fdatasync(wal_fd) < 0) {
+        perror("fdatasync stats log failed");
+    }
+}
+
+// Поток записи. Пока идет один fdatasync, новые записи копятся в pending
+// и уходят на диск следующим одним вызовом (групповая фиксация)
+static void* writer_thread(void* arg) {
+    (void)arg;
+    StatsRecord* batch = NULL;
+    int batch_cap = 0;
+    
+    pthread_mutex_lock(&store_mutex);
+    while (1) {
+        while (pending_len == 0 && !compact_entries && !stopping) {
+            pthread_cond_wait(&store_cond, &store_mutex);
+        }
+        if (pending_len == 0 && !compact_entries && stopping) {
+            break;
+        }
+        
+        // Забираем накопленные записи, отдавая пустой буфер взамен
+        StatsRecord* records = pending;
+        int count = pending_len;
+        int records_cap = pending_cap;
+        pending = batch;
+        pending_cap = batch_cap;
+        pending_len = 0;
+        batch = records;
+        batch_cap = records_cap;
+        
+        StatsEntry* entries = compact_entries;
+        int entry_count = compact_count;
+        uint64_t snapshot_seq = compact_seq;
+        compact_entries = NULL;
+        
+        pthread_mutex_unlock(&store_mutex);
+        
+        // Записи пачки идут по возрастанию seq. Если запрошен снимок,
+        // до обрезки журнала пишутся только записи, которые он учитывает:
+        // более поздние иначе были бы стерты вместе с журналом
+        int covered = count;
+        if (entries) {
+            covered = 0;
+            while (covered < count && records[covered].seq <= snapshot_seq) {
+                covered++;
+            }
+        }
+        append_records(records, covered);
+        
+        // Записи до snapshot_seq уже в журнале, поэтому при падении
+        // до подмены снимка ничего не теряется
+        if (entries) {
+            if (write_snapshot(entries, entry_count, snapshot_seq) == 0 &&
+                ftruncate(wal_fd, 0) < 0) {
+                perror("ftruncate stats log failed");
+            }
+            free(entries);
+        }
+        append_records(records + covered, count - covered);
+        
+        pthread_mutex_lock(&store_mutex);
+    }
+    pthread_mutex_unlock(&store_mutex);
+    
+    free(batch);
+    return NULL;
+}
+
+int stats_open(const char* dir, StatsApplyFn apply) {
+    snprintf(dir_path, sizeof(dir_path), "%s", dir);
+    snprintf(wal_path, sizeof(wal_path), "%s/%s", dir, STATS_WAL_FILE);
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/%s", dir, STATS_SNAPSHOT_FILE);
+    
+    wal_fd = open(wal_path, O_CREAT | O_RDWR | O_APPEND, 0644);
+    if (wal_fd < 0) {
+        perror("Failed to open stats log");
+        return -1;
+    }
+    
+    uint64_t last_seq = load_snapshot(apply);
+    if (replay_wal(last_seq, apply) < 0) {
+        close(wal_fd);
+        return -1;
+    }
+    
+    if (pthread_create(&writer, NULL, writer_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to start stats writer\n");
+        close(wal_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void stats_record_game(const char* winner, const char* loser) {
+    pthread_mutex_lock(&store_mutex);
+    
+    if (pending_len == pending_cap) {
+        int cap = pending_cap ? pending_cap * 2 : 64;
+        StatsRecord* grown = realloc(pending, cap * sizeof(StatsRecord));
+        if (!grown) {
+            pthread_mutex_unlock(&store_mutex);
+            fprintf(stderr, "Warning: stats record dropped (out of memory)\n");
+            return;
+        }
+        pending = grown;
+        pending_cap = cap;
+    }
+    
+    StatsRecord* record = &pending[pending_len++];
+    memset(record, 0, sizeof(*record));
+    record->seq = next_seq++;
+    strncpy(record->winner, winner, MAX_LOGIN - 1);
+    strncpy(record->loser, loser, MAX_LOGIN - 1);
+    record->checksum = record_checksum(record);
+    wal_records++;
+    
+    pthread_cond_signal(&store_cond);
+    pthread_mutex_unlock(&store_mutex);
+}
+
+bool stats_need_compaction() {
+    pthread_mutex_lock(&store_mutex);
+    bool need = wal_records >= STATS_COMPACT_RECORDS;
+    pthread_mutex_unlock(&store_mutex);
+    return need;
+}
+
+void stats_compact(StatsEntry* entries, int count) {
+    pthread_mutex_lock(&store_mutex);
+    
+    free(compact_entries);
+    compact_entries = entries;
+    compact_count = count;
+    compact_seq = next_seq - 1;
+    wal_records = 0;
+    
+    pthread_cond_signal(&store_cond);
+    pthread_mutex_unlock(&store_mutex);
+}
+
+void stats_close() {
+    if (wal_fd < 0) {
+        return;
+    }
+    
+    pthread_mutex_lock(&store_mutex);
+    stopping = true;
+    pthread_cond_signal(&store_cond);
+    pthread_mutex_unlock(&store_mutex);
+    
+    pthread_join(writer, NULL);
+    
+    free(pending);
+    pending = NULL;
+    close(wal_fd);
+    wal_fd = -1;
+}
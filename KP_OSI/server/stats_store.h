@@ -0,0 +1,44 @@
+#ifndef STATS_STORE_H
+#define STATS_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../shared/protocol.h"
+
+// Файлы хранилища в каталоге статистики
+#define STATS_WAL_FILE "sea_battle_stats.wal"
+#define STATS_SNAPSHOT_FILE "sea_battle_stats.snap"
+
+// После стольких записей журнала делается снимок и журнал обрезается
+#define STATS_COMPACT_RECORDS 1024
+
+// Строка снимка: итоговая статистика одного игрока
+typedef struct {
+    char login[MAX_LOGIN];
+    int32_t wins;
+    int32_t losses;
+} StatsEntry;
+
+// Прибавление побед и поражений игроку (при восстановлении)
+typedef void (*StatsApplyFn)(const char* login, int wins, int losses);
+
+// Открытие хранилища и запуск потока записи.
+// Если apply не NULL, через него проигрываются снимок и журнал.
+// Оборванный хвост журнала отбрасывается
+int stats_open(const char* dir, StatsApplyFn apply);
+
+// Запись результата игры в журнал (под players_mutex, без ожидания диска).
+// loser может быть пустой строкой, если соперник уже не в игре
+void stats_record_game(const char* winner, const char* loser);
+
+// Пора ли делать снимок
+bool stats_need_compaction();
+
+// Снимок статистики всех игроков (под players_mutex, чтобы снимок точно
+// соответствовал последней записи журнала). Хранилище забирает entries
+void stats_compact(StatsEntry* entries, int count);
+
+// Запись оставшегося журнала и остановка потока
+void stats_close();
+
+#endif // STATS_STORE_H
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <pthread.h>
+#include "../shared/events.h"
+#include "workers.h"
+
+// Поток будится, только если на него приходится хотя бы столько задач:
+// пробуждение стоит дороже, чем выполнение нескольких команд
+#define WORKER_MIN_TASKS 8
+
+#define DEQUE_EMPTY -1
+#define DEQUE_ABORT -2      // Кража проиграла гонку, стоит повторить
+
+// Дека Чейза-Лева фиксированной емкости. Владелец кладет и берет задачи
+// снизу, остальные потоки крадут сверху
+typedef struct {
+    _Alignas(CACHE_LINE) int64_t top;
+    _Alignas(CACHE_LINE) int64_t bottom;
+    int* tasks;
+    int64_t mask;
+} Deque;
+
+// Поток пула. go - futex, на котором поток ждет своей доли итерации
+typedef struct {
+    _Alignas(CACHE_LINE) uint32_t go;
+    Deque deque;
+    pthread_t thread;
+} Worker;
+
+static Worker* workers = NULL;
+static int worker_slots = 0;        // Размер workers
+static int worker_total = 1;        // Сколько потоков запущено
+static int active = 0;              // Потоков в текущем workers_run
+static uint32_t busy = 0;           // Сколько из них еще работает (futex)
+static bool stopping = false;
+static WorkerTaskFn task_fn = NULL;
+static __thread int self = 0;
+
+// Задачи кладутся, только пока потоки ждут (основным потоком)
+static void deque_push(Deque* d, int task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    d->tasks[b & d->mask] = task;
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+static int deque_take(Deque* d) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return DEQUE_EMPTY;
+    }
+    
+    int task = __atomic_load_n(&d->tasks[b & d->mask], __ATOMIC_RELAXED);
+    if (t == b) {
+        // Последняя задача: вор может забрать ее одновременно
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = DEQUE_EMPTY;
+        }
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static int deque_steal(Deque* d) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    
+    if (t >= b) {
+        return DEQUE_EMPTY;
+    }
+    
+    int task = __atomic_load_n(&d->tasks[t & d->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return DEQUE_ABORT;
+    }
+    return task;
+}
+
+// Кража у остальных потоков итерации. DEQUE_EMPTY - только если
+// за полный проход все деки оказались пустыми
+static int steal_task() {
+    while (1) {
+        bool retry = false;
+        for (int i = 1; i < active; i++) {
+            int task = deque_steal(&workers[(self + i) % active].deque);
+            if (task >= 0) {
+                return task;
+            }
+            retry |= task == DEQUE_ABORT;
+        }
+        if (!retry) {
+            return DEQUE_EMPTY;
+        }
+    }
+}
+
+// Новые задачи во время итерации не появляются, поэтому поток
+// заканчивает, как только красть больше нечего
+static void run_tasks() {
+    Deque* own = &workers[self].deque;
+    while (1) {
+        int task = deque_take(own);
+        if (task == DEQUE_EMPTY) {
+            task = steal_task();
+        }
+        if (task == DEQUE_EMPTY) {
+            return;
+        }
+        task_fn(task);
+    }
+}
+
+static void* worker_thread(void* arg) {
+    self = (int)(long)arg;
+    Worker* w = &workers[self];
+    
+    while (1) {
+        while (__atomic_load_n(&w->go, __ATOMIC_ACQUIRE) == 0) {
+            futex_wait(&w->go, 0, NULL);
+        }
+        __atomic_store_n(&w->go, 0, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        
+        run_tasks();
+        if (__atomic_sub_fetch(&busy, 1, __ATOMIC_ACQ_REL) == 0) {
+            futex_wake(&busy, 1);
+        }
+    }
+}
+
+static int64_t next_pow2(int64_t value) {
+    int64_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+int workers_start(int count, int capacity, WorkerTaskFn fn) {
+    workers = calloc(count, sizeof(Worker));
+    if (!workers) {
+        perror("calloc failed");
+        return -1;
+    }
+    worker_slots = count;
+    task_fn = fn;
+    
+    int64_t size = next_pow2(capacity > 0 ? capacity : 1);
+    for (int i = 0; i < count; i++) {
+        workers[i].deque.tasks = malloc(size * sizeof(int));
+        workers[i].deque.mask = size - 1;
+        if (!workers[i].deque.tasks) {
+            perror("malloc failed");
+            return -1;
+        }
+    }
+    
+    // Сигналы завершения обрабатывает основной поток
+    sigset_t blocked, old;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    
+    for (worker_total = 1; worker_total < count; worker_total++) {
+        if (pthread_create(&workers[worker_total].thread, NULL, worker_thread,
+                           (void*)(long)worker_total) != 0) {
+            fprintf(stderr, "Failed to start worker thread %d\n", worker_total);
+            break;
+        }
+    }
+    
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+void workers_run(const int* tasks, int count) {
+    if (count == 0) {
+        return;
+    }
+    
+    active = count / WORKER_MIN_TASKS;
+    if (active > worker_total) {
+        active = worker_total;
+    } else if (active < 1) {
+        active = 1;
+    }
+    
+    // Деки пусты с прошлой итерации, потоки ждут - задачи раздаются по кругу
+    for (int i = 0; i < count; i++) {
+        deque_push(&workers[i % active].deque, tasks[i]);
+    }
+    
+    __atomic_store_n(&busy, active - 1, __ATOMIC_RELEASE);
+    for (int i = 1; i < active; i++) {
+        __atomic_store_n(&workers[i].go, 1, __ATOMIC_RELEASE);
+        futex_wake(&workers[i].go, 1);
+    }
+    
+    run_tasks();
+    
+    uint32_t left;
+    while ((left = __atomic_load_n(&busy, __ATOMIC_ACQUIRE)) != 0) {
+        futex_wait(&busy, left, NULL);
+    }
+}
+
+void workers_stop() {
+    if (!workers) {
+        return;
+    }
+    
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    for (int i = 1; i < worker_total; i++) {
+        __atomic_store_n(&workers[i].go, 1, __ATOMIC_RELEASE);
+        futex_wake(&workers[i].go, 1);
+        pthread_join(workers[i].thread, NULL);
+    }
+    
+    for (int i = 0; i < worker_slots; i++) {
+        free(workers[i].deque.tasks);
+    }
+    free(workers);
+    workers = NULL;
+    worker_total = 1;
+}
+
+int workers_count() {
+    return worker_total;
+}
+
+int worker_self() {
+    return self;
+}
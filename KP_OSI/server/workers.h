@@ -0,0 +1,27 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+// Пул потоков сервера. Итерация server_loop раздает задачи (номера
+// каналов с командами) по декам потоков; поток берет задачи со своего
+// конца деки, а закончив свои, ворует с чужих (деки Чейза-Лева).
+// Основной поток работает как поток 0 и ждет остальных, поэтому вне
+// workers_run код сервера по-прежнему выполняется в одном потоке
+typedef void (*WorkerTaskFn)(int task);
+
+#define MAX_WORKERS 256
+
+// Запуск count - 1 потоков (count >= 1). capacity - наибольшее число
+// задач за один вызов workers_run
+int workers_start(int count, int capacity, WorkerTaskFn fn);
+
+// Выполнение count задач всеми потоками; возврат, когда все выполнены.
+// Потоки будятся, только если задач достаточно, чтобы их разделить
+void workers_run(const int* tasks, int count);
+
+void workers_stop();
+
+// Число потоков и номер текущего (0 - основной поток)
+int workers_count();
+int worker_self();
+
+#endif // WORKERS_H
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "events.h"
+#include "seqlock.h"
+
+static int arena_add_game_chunk(ShmArena* arena);
+
+// Потоки одного процесса догоняют рост сегмента по очереди
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t round_up(uint64_t value, uint64_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static uint32_t next_pow2(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static uint64_t player_chunk_bytes(SharedData* shared) {
+    return round_up((uint64_t)shared->players_per_chunk * sizeof(Player), shared->arena_align);
+}
+
+static uint64_t game_chunk_bytes(SharedData* shared) {
+    return round_up((uint64_t)shared->games_per_chunk * sizeof(Game), shared->arena_align);
+}
+
+// arena_mutex держится очень недолго и не защищает игровые данные,
+// поэтому после падения владельца его достаточно пометить консистентным
+static void arena_lock(SharedData* shared) {
+    if (pthread_mutex_lock(&shared->arena_mutex) == EOWNERDEAD) {
+        pthread_mutex_consistent(&shared->arena_mutex);
+    }
+}
+
+static void arena_unlock(SharedData* shared) {
+    pthread_mutex_unlock(&shared->arena_mutex);
+}
+
+// Отображение size байт сегмента с offset на зарезервированные адреса.
+// С prefault страницы сразу заполняются и закрепляются в памяти
+static int arena_map_range(ShmArena* arena, void* base, uint64_t offset, uint64_t size) {
+    int flags = MAP_SHARED | MAP_FIXED | (arena->prefault ? MAP_POPULATE : 0);
+    void* addr = (char*)base + offset;
+    if (mmap(addr, size, arena->prot, flags, arena->fd, offset) == MAP_FAILED) {
+        return -1;
+    }
+    
+    static bool lock_warned = false;
+    if (arena->prefault && mlock(addr, size) < 0 && !lock_warned) {
+        perror("Warning: mlock failed, segment pages may be swapped out");
+        lock_warned = true;
+    }
+    return 0;
+}
+
+// Резервируем max_size адресов и отображаем первые size байт сегмента.
+// Огромные страницы требуют начала, выровненного на их размер (align)
+static int arena_map(ShmArena* arena, int fd, int prot, uint64_t size, uint64_t max_size,
+                     uint64_t align) {
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t slack = align > page ? align : 0;
+    char* reserved = mmap(NULL, max_size + slack, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        perror("mmap reserve failed");
+        return -1;
+    }
+    
+    // Лишние адреса до и после выровненного начала возвращаем
+    char* base = reserved;
+    if (slack) {
+        base = (char*)round_up((uintptr_t)reserved, align);
+        if (base > reserved) {
+            munmap(reserved, base - reserved);
+        }
+        munmap(base + max_size, reserved + slack - base);
+    }
+    
+    arena->fd = fd;
+    arena->prot = prot;
+    if (arena_map_range(arena, base, 0, size) < 0) {
+        perror("mmap failed");
+        munmap(base, max_size);
+        return -1;
+    }
+    
+    arena->shared = (SharedData*)base;
+    arena->mapped_size = size;
+    return 0;
+}
+
+// Увеличение сегмента на bytes байт (под arena_mutex).
+// Возвращает смещение новой области или 0 при ошибке
+static uint64_t arena_grow(ShmArena* arena, uint64_t bytes) {
+    SharedData* shared = arena->shared;
+    uint64_t offset = shared->arena_size;
+    
+    if (offset + bytes > shared->arena_max_size) {
+        return 0;
+    }
+    
+    if (ftruncate(arena->fd, offset + bytes) < 0) {
+        perror("ftruncate failed");
+        return 0;
+    }
+    
+    __atomic_store_n(&shared->arena_size, offset + bytes, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&shared->generation, 1, __ATOMIC_RELEASE);
+    
+    if (arena_sync(arena) < 0) {
+        return 0;
+    }
+    return offset;
+}
+
+int arena_create(ShmArena* arena, int fd, const ArenaConfig* config) {
+    uint64_t align = config->page_size ? config->page_size : (uint64_t)sysconf(_SC_PAGESIZE);
+    uint32_t players_per_chunk = config->max_players;
+    uint32_t games_per_chunk = config->max_games;
+    
+    // Раскладка: заголовок, индексы, каналы и битовая карта рассчитаны сразу
+    // на ARENA_MAX_CHUNKS чанков, чтобы их не пришлось перестраивать при росте.
+    // Каналов столько же, сколько может быть игроков
+    uint32_t player_index_size = next_pow2(2 * players_per_chunk * ARENA_MAX_CHUNKS);
+    uint32_t game_index_size = next_pow2(2 * games_per_chunk * ARENA_MAX_CHUNKS);
+    uint32_t channel_count = players_per_chunk * ARENA_MAX_CHUNKS;
+    uint32_t pending_words = (channel_count + 63) / 64;
+    uint32_t match_size = next_pow2(channel_count);  // По заявке на канал
+    
+    uint64_t offset = round_up(sizeof(SharedData), CACHE_LINE);
+    uint64_t player_index_off = offset;
+    offset += (uint64_t)player_index_size * sizeof(int32_t);
+    uint64_t game_index_off = offset;
+    offset += (uint64_t)game_index_size * sizeof(int32_t);
+    uint64_t channels_off = round_up(offset, CACHE_LINE);
+    offset = channels_off + (uint64_t)channel_count * sizeof(Channel);
+    uint64_t pending_off = round_up(offset, CACHE_LINE);
+    offset = pending_off + (uint64_t)pending_words * sizeof(uint64_t);
+    uint64_t ready_off = round_up(offset, CACHE_LINE);
+    offset = ready_off + (uint64_t)pending_words * sizeof(uint64_t);
+    uint64_t live_off = round_up(offset, CACHE_LINE);
+    offset = live_off + (uint64_t)games_per_chunk * ARENA_MAX_CHUNKS * sizeof(int32_t);
+    uint64_t match_off = round_up(offset, CACHE_LINE);
+    offset = match_off + (uint64_t)match_size * sizeof(MatchTicket);
+    uint64_t header_size = round_up(offset, align);
+    
+    uint64_t max_size = header_size + ARENA_MAX_CHUNKS *
+        (round_up((uint64_t)players_per_chunk * sizeof(Player), align) +
+         round_up((uint64_t)games_per_chunk * sizeof(Game), align));
+    
+    // Обнуляем старое содержимое
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, header_size) < 0) {
+        perror("ftruncate failed");
+        return -1;
+    }
+    
+    if (arena_map(arena, fd, PROT_READ | PROT_WRITE, header_size, max_size, align) < 0) {
+        return -1;
+    }
+    
+    SharedData* shared = arena->shared;
+    shared->version = SHM_VERSION;
+    shared->arena_size = header_size;
+    shared->arena_max_size = max_size;
+    shared->arena_align = align;
+    shared->prefaulted = arena->prefault;
+    shared->players_per_chunk = players_per_chunk;
+    shared->games_per_chunk = games_per_chunk;
+    shared->player_index_off = player_index_off;
+    shared->player_index_size = player_index_size;
+    shared->game_index_off = game_index_off;
+    shared->game_index_size = game_index_size;
+    shared->channels_off = channels_off;
+    shared->channel_count = channel_count;
+    shared->pending_off = pending_off;
+    shared->pending_words = pending_words;
+    shared->ready_off = ready_off;
+    shared->live_off = live_off;
+    shared->match_off = match_off;
+    shared->match_size = match_size;
+    shared->free_game = -1;
+    
+    MatchTicket* tickets = arena_at(shared, match_off);
+    for (uint32_t i = 0; i < match_size; i++) {
+        tickets[i].seq = i;
+    }
+    
+    // Инициализация мьютексов с атрибутами для shared memory
+    pthread_mutexattr_init(&shared->mutex_attr);
+    pthread_mutexattr_setpshared(&shared->mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&shared->mutex_attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->mutex, &shared->mutex_attr);
+    pthread_mutex_init(&shared->players_mutex, &shared->mutex_attr);
+    pthread_mutex_init(&shared->arena_mutex, &shared->mutex_attr);
+    
+    arena->generation = shared->generation;
+    
+    // Первые чанки - начальная емкость
+    if (arena_add_player_chunk(arena) < 0 || arena_add_game_chunk(arena) < 0) {
+        arena_detach(arena);
+        return -1;
+    }
+    
+    shared->initialized = SHM_MAGIC;
+    return 0;
+}
+
+int arena_attach(ShmArena* arena, int fd, int prot) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat failed");
+        return -1;
+    }
+    
+    if ((size_t)st.st_size < sizeof(SharedData)) {
+        return -2;
+    }
+    
+    // Сначала читаем только заголовок, чтобы узнать размеры.
+    // st_blksize - размер страницы сегмента (у hugetlbfs - огромной)
+    size_t header_size = round_up(sizeof(SharedData), st.st_blksize);
+    SharedData* header = mmap(NULL, header_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+    
+    int valid = header->initialized == SHM_MAGIC && header->version == SHM_VERSION;
+    uint64_t size = __atomic_load_n(&header->arena_size, __ATOMIC_ACQUIRE);
+    uint64_t max_size = header->arena_max_size;
+    uint64_t align = header->arena_align;
+    uint32_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    munmap(header, header_size);
+    
+    if (!valid) {
+        return -2;
+    }
+    
+    if (arena_map(arena, fd, prot, size, max_size, align) < 0) {
+        return -1;
+    }
+    arena->generation = generation;
+    
+    // Сегмент мог вырасти, пока мы его отображали
+    return arena_sync(arena);
+}
+
+void arena_detach(ShmArena* arena) {
+    if (arena->shared) {
+        munmap(arena->shared, arena->shared->arena_max_size);
+        arena->shared = NULL;
+    }
+    arena->mapped_size = 0;
+}
+
+// Уже отображенная часть не трогается, поэтому другие потоки могут
+// читать ее, пока один из них доотображает хвост
+int arena_sync(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    uint32_t generation = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE);
+    
+    if (generation == __atomic_load_n(&arena->generation, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&sync_mutex);
+    
+    uint64_t size = __atomic_load_n(&shared->arena_size, __ATOMIC_ACQUIRE);
+    uint64_t mapped = arena->mapped_size;
+    if (size > mapped) {
+        // Доотображаем новый хвост поверх зарезервированных адресов
+        if (arena_map_range(arena, shared, mapped, size - mapped) < 0) {
+            perror("mmap remap failed");
+            pthread_mutex_unlock(&sync_mutex);
+            return -1;
+        }
+        __atomic_store_n(&arena->mapped_size, size, __ATOMIC_RELEASE);
+    }
+    
+    __atomic_store_n(&arena->generation, generation, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sync_mutex);
+    return 0;
+}
+
+int arena_add_player_chunk(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    
+    arena_lock(shared);
+    
+    uint32_t chunk = shared->player_chunks;
+    uint64_t offset = 0;
+    if (chunk < ARENA_MAX_CHUNKS) {
+        offset = arena_grow(arena, player_chunk_bytes(shared));
+    }
+    if (offset == 0) {
+        arena_unlock(shared);
+        return -1;
+    }
+    shared->player_chunk_off[chunk] = offset;
+    
+    arena_unlock(shared);
+    
+    // Новые страницы сегмента уже заполнены нулями
+    __atomic_store_n(&shared->player_chunks, chunk + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Добавление чанка игр (под mutex): все его слоты попадают в список свободных
+static int arena_add_game_chunk(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    
+    arena_lock(shared);
+    
+    uint32_t chunk = shared->game_chunks;
+    uint64_t offset = 0;
+    if (chunk < ARENA_MAX_CHUNKS) {
+        offset = arena_grow(arena, game_chunk_bytes(shared));
+    }
+    if (offset == 0) {
+        arena_unlock(shared);
+        return -1;
+    }
+    shared->game_chunk_off[chunk] = offset;
+    
+    arena_unlock(shared);
+    
+    // Слоты связываются по возрастанию id, чтобы новые игры шли подряд
+    int first = chunk * shared->games_per_chunk;
+    Game* games = arena_at(shared, offset);
+    for (uint32_t i = 0; i < shared->games_per_chunk; i++) {
+        pthread_mutex_init(&games[i].mutex, &shared->mutex_attr);
+        games[i].in_use = false;
+        games[i].next_free = (i + 1 < shared->games_per_chunk) ? first + (int)i + 1
+                                                               : shared->free_game;
+    }
+    shared->free_game = first;
+    
+    __atomic_store_n(&shared->game_chunks, chunk + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int arena_reserve_games(ShmArena* arena, int count) {
+    while (arena_game_capacity(arena->shared) < count) {
+        if (arena_add_game_chunk(arena) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int arena_alloc_game(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    
+    if (shared->free_game < 0 && arena_add_game_chunk(arena) < 0) {
+        return -1;
+    }
+    
+    int id = shared->free_game;
+    shared->free_game = arena_game(arena, id)->next_free;
+    return id;
+}
+
+void arena_publish_game(ShmArena* arena, int id) {
+    SharedData* shared = arena->shared;
+    int32_t* live = arena_at(shared, shared->live_off);
+    Game* game = arena_game(arena, id);
+    
+    // Изменения массива живых игр обрамляются live_seq,
+    // чтобы клиенты могли копировать его без мьютекса
+    seqlock_write_begin(&shared->live_seq);
+    game->live_pos = shared->live_count;
+    live[shared->live_count] = id;
+    __atomic_store_n(&shared->live_count, shared->live_count + 1, __ATOMIC_RELAXED);
+    seqlock_write_end(&shared->live_seq);
+    
+    if (id >= shared->game_count) {
+        __atomic_store_n(&shared->game_count, id + 1, __ATOMIC_RELEASE);
+    }
+}
+
+void arena_rebuild_games(ShmArena* arena) {
+    SharedData* shared = arena->shared;
+    int32_t* live = arena_at(shared, shared->live_off);
+    int capacity = arena_game_capacity(shared);
+    
+    // Свободные слоты связываются по возрастанию id, как при выделении чанка
+    shared->free_game = -1;
+    for (int id = capacity - 1; id >= 0; id--) {
+        Game* game = arena_game(arena, id);
+        if (!game->in_use) {
+            game->next_free = shared->free_game;
+            shared->free_game = id;
+        }
+    }
+    
+    // live_seq мог остаться нечетным, тогда запись уже "открыта"
+    if (!(shared->live_seq & 1)) {
+        seqlock_write_begin(&shared->live_seq);
+    }
+    int count = 0;
+    for (int id = 0; id < capacity; id++) {
+        Game* game = arena_game(arena, id);
+        if (!game->in_use) {
+            continue;
+        }
+        game->live_pos = count;
+        __atomic_store_n(&live[count++], id, __ATOMIC_RELAXED);
+        if (id >= shared->game_count) {
+            __atomic_store_n(&shared->game_count, id + 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_store_n(&shared->live_count, count, __ATOMIC_RELAXED);
+    seqlock_write_end(&shared->live_seq);
+}
+
+int arena_live_games(ShmArena* arena, int* ids) {
+    SharedData* shared = arena->shared;
+    int32_t* live = arena_at(shared, shared->live_off);
+    uint32_t seq;
+    int count;
+    
+    // Повторяем копирование, если сервер менял массив во время чтения
+    do {
+        seq = seqlock_read_begin(&shared->live_seq);
+        count = __atomic_load_n(&shared->live_count, __ATOMIC_RELAXED);
+        if (count < 0 || count > arena_game_limit(shared)) {
+            count = 0;
+        }
+        for (int i = 0; i < count; i++) {
+            ids[i] = __atomic_load_n(&live[i], __ATOMIC_RELAXED);
+        }
+    } while (seqlock_read_retry(&shared->live_seq, seq));
+    
+    return count;
+}
+
+void arena_free_game(ShmArena* arena, int id) {
+    SharedData* shared = arena->shared;
+    int32_t* live = arena_at(shared, shared->live_off);
+    Game* game = arena_game(arena, id);
+    
+    // Удаляем из массива живых игр, переставляя на место последнюю
+    seqlock_write_begin(&shared->live_seq);
+    int last = live[shared->live_count - 1];
+    __atomic_store_n(&live[game->live_pos], last, __ATOMIC_RELAXED);
+    __atomic_store_n(&shared->live_count, shared->live_count - 1, __ATOMIC_RELAXED);
+    arena_game(arena, last)->live_pos = game->live_pos;
+    seqlock_write_end(&shared->live_seq);
+    
+    seqlock_write_begin(&game->seq);
+    game->in_use = false;
+    game->generation++;
+    game->finished_at = 0;
+    seqlock_write_end(&game->seq);
+    notify_game(game);
+    game->next_free = shared->free_game;
+    shared->free_game = id;
+}
@@ -0,0 +1,117 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "protocol.h"
+
+// Отображение сегмента в текущем процессе.
+// Каждый процесс резервирует arena_max_size адресов сразу, поэтому при росте
+// сегмента начало не сдвигается и указатели на Player/Game остаются верными.
+typedef struct {
+    SharedData* shared;     // Начало сегмента
+    int fd;
+    int prot;               // PROT_READ | PROT_WRITE или только PROT_READ
+    size_t mapped_size;     // Сколько байт отображено в этом процессе
+    uint32_t generation;    // Поколение сегмента, которое видел процесс
+    bool prefault;          // Отображать с MAP_POPULATE и mlock (задается до create/attach)
+} ShmArena;
+
+// Начальная емкость (размер одного чанка) и страницы сегмента
+typedef struct {
+    uint32_t max_players;
+    uint32_t max_games;
+    uint64_t page_size;     // Размер огромной страницы fd (0 - обычные страницы)
+} ArenaConfig;
+
+// Создание нового сегмента (сервер). Старое содержимое fd стирается
+int arena_create(ShmArena* arena, int fd, const ArenaConfig* config);
+
+// Подключение к готовому сегменту.
+// Возвращает -1 при ошибке, -2 если сегмент не инициализирован или другой версии
+int arena_attach(ShmArena* arena, int fd, int prot);
+
+void arena_detach(ShmArena* arena);
+
+// Догоняем рост сегмента, сделанный другим процессом (или другим
+// потоком сервера). Можно вызывать из нескольких потоков
+int arena_sync(ShmArena* arena);
+
+// Добавление чанка игроков (под players_mutex). -1 если достигнут предел
+int arena_add_player_chunk(ShmArena* arena);
+
+// Рост сегмента, пока в нем не поместятся игры с id меньше count
+// (под mutex). -1 если это больше предела
+int arena_reserve_games(ShmArena* arena, int count);
+
+// Выдача свободного слота игры (под mutex), при необходимости сегмент растет.
+// Слот нужно инициализировать и пометить in_use под его мьютексом,
+// затем опубликовать через arena_publish_game
+int arena_alloc_game(ShmArena* arena);
+
+// Добавление игры в массив живых игр (под mutex)
+void arena_publish_game(ShmArena* arena, int id);
+
+// Копия массива живых игр в ids, возвращает их количество.
+// Мьютекс не нужен: чтение повторяется, если массив менялся (live_seq).
+// ids должен вмещать arena_game_limit элементов
+int arena_live_games(ShmArena* arena, int* ids);
+
+// Возврат слота в список свободных (под mutex и мьютексом игры).
+// Поколение слота увеличивается, чтобы клиенты заметили устаревший id
+void arena_free_game(ShmArena* arena, int id);
+
+// Список свободных слотов и массив живых игр заново по флагам in_use
+// (под mutex, после смерти его прежнего владельца)
+void arena_rebuild_games(ShmArena* arena);
+
+static inline void* arena_at(SharedData* shared, uint64_t offset) {
+    return (char*)shared + offset;
+}
+
+static inline int arena_player_capacity(SharedData* shared) {
+    return shared->players_per_chunk *
+           __atomic_load_n(&shared->player_chunks, __ATOMIC_ACQUIRE);
+}
+
+// Предельное число игроков при всех чанках
+static inline int arena_player_limit(SharedData* shared) {
+    return shared->players_per_chunk * ARENA_MAX_CHUNKS;
+}
+
+// Предельное число игр при всех чанках
+static inline int arena_game_limit(SharedData* shared) {
+    return shared->games_per_chunk * ARENA_MAX_CHUNKS;
+}
+
+static inline int arena_game_capacity(SharedData* shared) {
+    return shared->games_per_chunk *
+           __atomic_load_n(&shared->game_chunks, __ATOMIC_ACQUIRE);
+}
+
+static inline Player* arena_player(ShmArena* arena, int idx) {
+    SharedData* shared = arena->shared;
+    uint64_t offset = shared->player_chunk_off[idx / shared->players_per_chunk] +
+                      (uint64_t)(idx % shared->players_per_chunk) * sizeof(Player);
+    if (offset + sizeof(Player) > __atomic_load_n(&arena->mapped_size, __ATOMIC_ACQUIRE)) {
+        arena_sync(arena);
+    }
+    return arena_at(shared, offset);
+}
+
+static inline Channel* arena_channel(SharedData* shared, int idx) {
+    return (Channel*)arena_at(shared, shared->channels_off) + idx;
+}
+
+static inline Game* arena_game(ShmArena* arena, int id) {
+    SharedData* shared = arena->shared;
+    uint64_t offset = shared->game_chunk_off[id / shared->games_per_chunk] +
+                      (uint64_t)(id % shared->games_per_chunk) * sizeof(Game);
+    if (offset + sizeof(Game) > __atomic_load_n(&arena->mapped_size, __ATOMIC_ACQUIRE)) {
+        arena_sync(arena);
+    }
+    return arena_at(shared, offset);
+}
+
+#endif // ARENA_H
@@ -0,0 +1,87 @@
+#include "board.h"
+
+Bitboard ship_mask(int x, int y, int size, ShipDirection dir) {
+    if (x < 0 || y < 0 || size < 1) {
+        return 0;
+    }
+    
+    if (dir == DIR_HORIZONTAL) {
+        if (x + size > BOARD_SIZE || y >= BOARD_SIZE) return 0;
+        // size бит подряд в одной строке
+        return (((Bitboard)1 << size) - 1) << (y * BOARD_SIZE + x);
+    }
+    
+    if (y + size > BOARD_SIZE || x >= BOARD_SIZE) return 0;
+    Bitboard mask = 0;
+    for (int i = 0; i < size; i++) {
+        mask |= bb_cell(x, y + i);
+    }
+    return mask;
+}
+
+bool fleet_can_place(const Fleet* fleet, int x, int y, int size, ShipDirection dir) {
+    Bitboard mask = ship_mask(x, y, size, dir);
+    return mask != 0 && fleet->ships_count < TOTAL_SHIPS &&
+           (mask & bb_neighbors(fleet->ships)) == 0;
+}
+
+void fleet_place(Fleet* fleet, int x, int y, int size, ShipDirection dir) {
+    fleet_add_ship(fleet, ship_mask(x, y, size, dir));
+}
+
+void fleet_add_ship(Fleet* fleet, Bitboard mask) {
+    int ship = fleet->ships_count++;
+    fleet->ships_left++;
+    
+    fleet->ship_mask[ship] = mask;
+    fleet->ships |= mask;
+    
+    for (int cell = 0; cell < BOARD_SIZE * BOARD_SIZE; cell++) {
+        if (mask & ((Bitboard)1 << cell)) {
+            fleet->ship_at[cell] = ship + 1;
+        }
+    }
+}
+
+int fleet_next_ship_size(const Fleet* fleet) {
+    static const int sizes[TOTAL_SHIPS] = {4, 3, 3, 2, 2, 2, 1, 1, 1, 1};
+    return fleet->ships_count < TOTAL_SHIPS ? sizes[fleet->ships_count] : 0;
+}
+
+int fleet_shot(Fleet* fleet, int x, int y) {
+    // Проверяем координаты
+    if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE) {
+        return -1;
+    }
+    
+    Bitboard cell = bb_cell(x, y);
+    if ((fleet->hits | fleet->misses) & cell) {
+        return -2;  // Уже стреляли сюда
+    }
+    
+    if (!(fleet->ships & cell)) {
+        fleet->misses |= cell;
+        return 0;
+    }
+    
+    fleet->hits |= cell;
+    
+    // Корабль потоплен, если попали во все его клетки
+    Bitboard ship = fleet->ship_mask[fleet->ship_at[y * BOARD_SIZE + x] - 1];
+    if ((ship & ~fleet->hits) == 0) {
+        fleet->sunk |= ship;
+        fleet->ships_left--;
+        return 2;
+    }
+    return 1;
+}
+
+CellType fleet_cell(const Fleet* fleet, int x, int y) {
+    Bitboard cell = bb_cell(x, y);
+    
+    if (fleet->sunk & cell) return CELL_SUNK;
+    if (fleet->hits & cell) return CELL_HIT;
+    if (fleet->misses & cell) return CELL_MISS;
+    if (fleet->ships & cell) return CELL_SHIP;
+    return CELL_EMPTY;
+}
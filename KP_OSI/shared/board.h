@@ -0,0 +1,74 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdbool.h>
+#include "protocol.h"
+
+// Все 100 клеток поля
+#define BB_BOARD (((Bitboard)1 << (BOARD_SIZE * BOARD_SIZE)) - 1)
+
+// Столбец x (используется, чтобы сдвиг по горизонтали не переносил биты между строками)
+#define BB_COLUMN(x) (((Bitboard)1 << (x)) | ((Bitboard)1 << ((x) + 10)) | \
+                      ((Bitboard)1 << ((x) + 20)) | ((Bitboard)1 << ((x) + 30)) | \
+                      ((Bitboard)1 << ((x) + 40)) | ((Bitboard)1 << ((x) + 50)) | \
+                      ((Bitboard)1 << ((x) + 60)) | ((Bitboard)1 << ((x) + 70)) | \
+                      ((Bitboard)1 << ((x) + 80)) | ((Bitboard)1 << ((x) + 90)))
+
+static inline Bitboard bb_cell(int x, int y) {
+    return (Bitboard)1 << (y * BOARD_SIZE + x);
+}
+
+static inline bool bb_test(Bitboard board, int x, int y) {
+    return (board & bb_cell(x, y)) != 0;
+}
+
+// Клетки доски вместе со всеми соседями (включая диагонали)
+static inline Bitboard bb_neighbors(Bitboard board) {
+    Bitboard row = board |
+                   ((board & ~BB_COLUMN(BOARD_SIZE - 1)) << 1) |
+                   ((board & ~BB_COLUMN(0)) >> 1);
+    return (row | (row << BOARD_SIZE) | (row >> BOARD_SIZE)) & BB_BOARD;
+}
+
+// Клетки доски вместе с соседями по горизонтали и вертикали
+static inline Bitboard bb_cross(Bitboard board) {
+    return (board |
+            ((board & ~BB_COLUMN(BOARD_SIZE - 1)) << 1) |
+            ((board & ~BB_COLUMN(0)) >> 1) |
+            (board << BOARD_SIZE) | (board >> BOARD_SIZE)) & BB_BOARD;
+}
+
+// Число клеток доски
+static inline int bb_count(Bitboard board) {
+    return __builtin_popcountll((uint64_t)board) + __builtin_popcountll((uint64_t)(board >> 64));
+}
+
+// Клетки корабля, 0 если корабль выходит за поле
+Bitboard ship_mask(int x, int y, int size, ShipDirection dir);
+
+// Проверка возможности размещения: корабли не касаются даже по диагонали
+bool fleet_can_place(const Fleet* fleet, int x, int y, int size, ShipDirection dir);
+
+// Размещение корабля (после fleet_can_place)
+void fleet_place(Fleet* fleet, int x, int y, int size, ShipDirection dir);
+
+// Добавление корабля по готовой маске клеток (при чтении повтора)
+void fleet_add_ship(Fleet* fleet, Bitboard mask);
+
+// Размер следующего корабля по правилам (4, 3, 3, 2, 2, 2, 1, 1, 1, 1),
+// 0 если флот уже расставлен
+int fleet_next_ship_size(const Fleet* fleet);
+
+// Выстрел по флоту: -1 неверные координаты, -2 уже стреляли,
+// 0 промах, 1 попадание, 2 корабль потоплен
+int fleet_shot(Fleet* fleet, int x, int y);
+
+// Все корабли потоплены (счетчик уменьшается при каждом потоплении)
+static inline bool fleet_destroyed(const Fleet* fleet) {
+    return fleet->ships_count > 0 && fleet->ships_left == 0;
+}
+
+// Тип клетки для отображения
+CellType fleet_cell(const Fleet* fleet, int x, int y);
+
+#endif // BOARD_H
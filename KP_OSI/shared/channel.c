@@ -0,0 +1,83 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "arena.h"
+#include "channel.h"
+#include "events.h"
+
+int channel_open(SharedData* shared) {
+    pid_t self = getpid();
+    
+    for (uint32_t i = 0; i < shared->channel_count; i++) {
+        Channel* ch = arena_channel(shared, i);
+        pid_t expected = 0;
+        if (__atomic_load_n(&ch->owner_pid, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&ch->owner_pid, &expected, self, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            // Пока канал не отправил CMD_LOGIN, он не привязан к игроку
+            ch->player_idx = -1;
+            ch->batched = 0;
+            __atomic_store_n(&ch->matching, MATCH_IDLE, __ATOMIC_RELEASE);
+            return i;
+        }
+    }
+    return -1;
+}
+
+int channel_call(SharedData* shared, int channel, Command* cmd, Reply* reply) {
+    Channel* ch = arena_channel(shared, channel);
+    static uint32_t next_tag = 0;
+    
+    cmd->tag = ++next_tag;
+    
+    // Клиент ждет ответа на каждую команду, поэтому кольцо не переполняется
+    uint32_t tail = ch->cmd_tail;
+    ch->commands[tail % CHANNEL_RING_SIZE] = *cmd;
+    __atomic_store_n(&ch->cmd_tail, tail + 1, __ATOMIC_RELEASE);
+    notify_server(shared, channel);
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += CHANNEL_TIMEOUT_SEC;
+    
+    while (1) {
+        uint32_t reply_tail = __atomic_load_n(&ch->reply_tail, __ATOMIC_ACQUIRE);
+        
+        // Ответы на команды, которые раньше не дождались, пропускаем
+        while (ch->reply_head != reply_tail) {
+            *reply = ch->replies[ch->reply_head % CHANNEL_RING_SIZE];
+            __atomic_store_n(&ch->reply_head, ch->reply_head + 1, __ATOMIC_RELEASE);
+            if (reply->tag == cmd->tag) {
+                return 0;
+            }
+        }
+        
+        // Ответы, записанные до остановки сервера, уже забраны
+        if (server_retired(shared)) {
+            return -1;
+        }
+        
+        struct timespec now, timeout;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (timeout.tv_nsec < 0) {
+            timeout.tv_sec--;
+            timeout.tv_nsec += 1000000000L;
+        }
+        if (timeout.tv_sec < 0) {
+            return -1;
+        }
+        
+        // Если сервер уже записал ответ, futex_wait сразу вернет EAGAIN
+        if (futex_wait(&ch->reply_tail, reply_tail, &timeout) < 0 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            return -1;
+        }
+    }
+}
+
+void channel_close(SharedData* shared, int channel) {
+    Channel* ch = arena_channel(shared, channel);
+    __atomic_store_n(&ch->owner_pid, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,26 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "protocol.h"
+
+// Сколько клиент ждет ответа сервера, прежде чем сдаться
+#define CHANNEL_TIMEOUT_SEC 5
+
+// Захват свободного канала текущим процессом. -1 если все каналы заняты
+int channel_open(SharedData* shared);
+
+// Отправка команды и ожидание ответа на нее.
+// Возвращает -1, если сервер не ответил за CHANNEL_TIMEOUT_SEC секунд
+// или остановился (server_retired)
+int channel_call(SharedData* shared, int channel, Command* cmd, Reply* reply);
+
+// Сервер сохранил состояние в снимок и остановился: ответа в этом
+// сегменте уже не будет, нужно подключиться к следующему запуску
+static inline bool server_retired(SharedData* shared) {
+    return __atomic_load_n(&shared->initialized, __ATOMIC_SEQ_CST) == SHM_RETIRED;
+}
+
+// Освобождение канала (после того как получены все ответы)
+void channel_close(SharedData* shared, int channel);
+
+#endif // CHANNEL_H
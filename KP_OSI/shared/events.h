@@ -0,0 +1,82 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "protocol.h"
+
+// Обертки над futex (без FUTEX_PRIVATE_FLAG - память разделяется между процессами)
+static inline int futex_wait(uint32_t* addr, uint32_t expected, const struct timespec* timeout) {
+    return syscall(SYS_futex, addr, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static inline int futex_wake(uint32_t* addr, int count) {
+    return syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+// Будим сервер: он заново проверит каналы и очередь подбора
+static inline void wake_server(SharedData* shared) {
+    __atomic_fetch_add(&shared->event_seq, 1, __ATOMIC_SEQ_CST);
+    
+    // Системный вызов только если сервер действительно спит
+    if (__atomic_load_n(&shared->server_sleeping, __ATOMIC_SEQ_CST)) {
+        futex_wake(&shared->event_seq, 1);
+    }
+}
+
+// Помечаем канал, в котором есть новые команды, не будя сервер.
+// Бит ставится атомарно, поэтому вызывать можно и без мьютекса.
+static inline void mark_channel(SharedData* shared, int channel) {
+    uint64_t* pending = (uint64_t*)((char*)shared + shared->pending_off);
+    __atomic_fetch_or(&pending[channel / 64], (uint64_t)1 << (channel % 64), __ATOMIC_RELEASE);
+}
+
+// Помечаем канал и будим сервер
+static inline void notify_server(SharedData* shared, int channel) {
+    mark_channel(shared, channel);
+    wake_server(shared);
+}
+
+// Итерация сервера закончена: шлюзы заберут ответы своих каналов и
+// проверят игры. Системный вызов только если какой-то шлюз спит
+static inline void publish_changes(SharedData* shared) {
+    __atomic_fetch_add(&shared->change_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->change_waiters, __ATOMIC_SEQ_CST)) {
+        futex_wake(&shared->change_seq, INT_MAX);
+    }
+}
+
+// Сон шлюза, пока change_seq равен seen_seq
+static inline void wait_changes(SharedData* shared, uint32_t seen_seq, const struct timespec* timeout) {
+    __atomic_fetch_add(&shared->change_waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->change_seq, __ATOMIC_SEQ_CST) == seen_seq) {
+        futex_wait(&shared->change_seq, seen_seq, timeout);
+    }
+    __atomic_fetch_sub(&shared->change_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+// Сообщаем ждущим клиентам, что игра изменилась (под мьютексом игры)
+static inline void notify_game(Game* game) {
+    __atomic_fetch_add(&game->move_seq, 1, __ATOMIC_SEQ_CST);
+    
+    // Системный вызов только если кто-то ждет
+    if (__atomic_load_n(&game->watchers, __ATOMIC_SEQ_CST)) {
+        futex_wake(&game->move_seq, INT_MAX);
+    }
+}
+
+// Сон, пока move_seq равен seen_seq (без мьютекса игры).
+// seen_seq нужно прочитать до проверки состояния игры
+static inline void wait_game_change(Game* game, uint32_t seen_seq, const struct timespec* timeout) {
+    __atomic_fetch_add(&game->watchers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&game->move_seq, __ATOMIC_SEQ_CST) == seen_seq) {
+        futex_wait(&game->move_seq, seen_seq, timeout);
+    }
+    __atomic_fetch_sub(&game->watchers, 1, __ATOMIC_SEQ_CST);
+}
+
+#endif // EVENTS_H
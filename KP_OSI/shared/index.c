@@ -0,0 +1,116 @@
+#include <string.h>
+#include "index.h"
+
+uint32_t hash_string(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Линейное пробирование. Строки сравниваются только при совпадении хеша
+int index_find_player(ShmArena* arena, const char* login, uint32_t hash) {
+    int32_t* table = arena_at(arena->shared, arena->shared->player_index_off);
+    uint32_t mask = arena->shared->player_index_size - 1;
+    
+    for (uint32_t pos = hash & mask; ; pos = (pos + 1) & mask) {
+        int32_t entry = table[pos];
+        if (entry == INDEX_EMPTY) {
+            return -1;
+        }
+        
+        Player* p = arena_player(arena, entry - 1);
+        if (p->login_hash == hash && strcmp(p->login, login) == 0) {
+            return entry - 1;
+        }
+    }
+}
+
+void index_insert_player(ShmArena* arena, int idx) {
+    int32_t* table = arena_at(arena->shared, arena->shared->player_index_off);
+    uint32_t mask = arena->shared->player_index_size - 1;
+    uint32_t pos = arena_player(arena, idx)->login_hash & mask;
+    
+    while (table[pos] != INDEX_EMPTY) {
+        pos = (pos + 1) & mask;
+    }
+    table[pos] = idx + 1;
+}
+
+// Пробирование ограничено размером таблицы: полная таблица не зацикливает поиск
+int index_find_game(ShmArena* arena, const char* name, uint32_t hash) {
+    int32_t* table = arena_at(arena->shared, arena->shared->game_index_off);
+    uint32_t size = arena->shared->game_index_size;
+    uint32_t mask = size - 1;
+    
+    for (uint32_t i = 0, pos = hash & mask; i < size; i++, pos = (pos + 1) & mask) {
+        int32_t entry = table[pos];
+        if (entry == INDEX_EMPTY) {
+            return -1;
+        }
+        
+        Game* g = arena_game(arena, entry - 1);
+        if (g->name_hash == hash && strcmp(g->name, name) == 0) {
+            return entry - 1;
+        }
+    }
+    return -1;
+}
+
+void index_insert_game(ShmArena* arena, int idx) {
+    int32_t* table = arena_at(arena->shared, arena->shared->game_index_off);
+    uint32_t mask = arena->shared->game_index_size - 1;
+    uint32_t pos = arena_game(arena, idx)->name_hash & mask;
+    
+    while (table[pos] != INDEX_EMPTY) {
+        pos = (pos + 1) & mask;
+    }
+    table[pos] = idx + 1;
+}
+
+void index_rebuild_games(ShmArena* arena) {
+    int32_t* table = arena_at(arena->shared, arena->shared->game_index_off);
+    memset(table, 0, arena->shared->game_index_size * sizeof(int32_t));
+    
+    for (int i = 0; i < arena_game_capacity(arena->shared); i++) {
+        if (arena_game(arena, i)->in_use) {
+            index_insert_game(arena, i);
+        }
+    }
+}
+
+// Удаление со сдвигом назад: записи, стоящие за освобожденной ячейкой
+// дальше от своей начальной позиции, переезжают в нее. Надгробий не
+// остается, поэтому пустые ячейки не кончаются, сколько бы игр ни
+// создавалось и ни освобождалось
+void index_remove_game(ShmArena* arena, int idx) {
+    int32_t* table = arena_at(arena->shared, arena->shared->game_index_off);
+    uint32_t size = arena->shared->game_index_size;
+    uint32_t mask = size - 1;
+    uint32_t hole = arena_game(arena, idx)->name_hash & mask;
+    
+    uint32_t i = 0;
+    while (i < size && table[hole] != idx + 1) {
+        if (table[hole] == INDEX_EMPTY) {
+            return;
+        }
+        hole = (hole + 1) & mask;
+        i++;
+    }
+    if (i == size) {
+        return;
+    }
+    table[hole] = INDEX_EMPTY;
+    
+    for (uint32_t pos = (hole + 1) & mask; table[pos] != INDEX_EMPTY; pos = (pos + 1) & mask) {
+        // Запись остается, если ее начальная позиция лежит между дыркой и ней
+        uint32_t home = arena_game(arena, table[pos] - 1)->name_hash & mask;
+        if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+            table[hole] = table[pos];
+            table[pos] = INDEX_EMPTY;
+            hole = pos;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include "protocol.h"
+#include "arena.h"
+
+// Пустая ячейка хеш-индекса
+#define INDEX_EMPTY 0
+
+// Хеш строки (FNV-1a)
+uint32_t hash_string(const char* str);
+
+// Поиск и добавление игроков (вызывать под players_mutex)
+int index_find_player(ShmArena* arena, const char* login, uint32_t hash);
+void index_insert_player(ShmArena* arena, int idx);
+
+// Поиск и добавление игр (вызывать под mutex)
+int index_find_game(ShmArena* arena, const char* name, uint32_t hash);
+void index_insert_game(ShmArena* arena, int idx);
+void index_remove_game(ShmArena* arena, int idx);  // Без надгробий (сдвиг назад)
+
+// Индекс игр заново по флагам in_use (после смерти владельца mutex)
+void index_rebuild_games(ShmArena* arena);
+
+#endif // INDEX_H
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "locks.h"
+
+// Глубже четырех уровней порядок блокировок не бывает
+#define MAX_HELD 8
+
+typedef struct {
+    pthread_mutex_t* mutex;
+    LockSite site;
+    uint64_t acquired_at;
+} HeldLock;
+
+static SharedData* stats_shared = NULL;
+static LockRecoverFn recover_fn = NULL;
+static __thread HeldLock held[MAX_HELD];
+static __thread int held_count = 0;
+
+static const char* site_names[LOCK_SITE_COUNT] = {
+    [LOCK_SERVER_CREATE_GAME] = "server: create game",
+    [LOCK_SERVER_RECLAIM] = "server: reclaim game",
+    [LOCK_SERVER_GAME_COMMAND] = "server: game command",
+    [LOCK_SERVER_PLAYERS] = "server: players table",
+    [LOCK_SERVER_RECOVERY] = "server: startup recovery",
+    [LOCK_SERVER_SNAPSHOT] = "server: state snapshot",
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void record(uint32_t* hist, uint64_t ns) {
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= LOCK_HIST_BUCKETS) {
+        bucket = LOCK_HIST_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void locks_init(SharedData* shared) {
+    stats_shared = shared;
+}
+
+void locks_on_owner_death(LockRecoverFn fn) {
+    recover_fn = fn;
+}
+
+void lock(pthread_mutex_t* mutex, LockSite site) {
+    LockStats* stats = stats_shared ? &stats_shared->lock_stats[site] : NULL;
+    
+    // Без конкуренции обходимся без замера ожидания
+    int ret = pthread_mutex_trylock(mutex);
+    if (ret == EBUSY) {
+        uint64_t start = now_ns();
+        ret = pthread_mutex_lock(mutex);
+        if (stats) {
+            uint64_t waited = now_ns() - start;
+            __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stats->wait_ns, waited, __ATOMIC_RELAXED);
+            record(stats->wait_hist, waited);
+        }
+    } else if (stats && ret == 0) {
+        record(stats->wait_hist, 0);
+    }
+    
+    // Владелец умер, не отпустив мьютекс: мьютекс уже наш, но данные
+    // под ним могли остаться наполовину измененными. Чиним их до возврата
+    if (ret == EOWNERDEAD) {
+        ret = pthread_mutex_consistent(mutex);
+        if (stats) {
+            __atomic_fetch_add(&stats->owner_died, 1, __ATOMIC_RELAXED);
+        }
+        if (ret == 0 && recover_fn) {
+            recover_fn(mutex);
+        }
+    }
+    
+    if (ret != 0) {
+        fprintf(stderr, "Ошибка блокировки мьютекса: %s\n", strerror(ret));
+        exit(1);
+    }
+    
+    if (stats) {
+        __atomic_fetch_add(&stats->acquired, 1, __ATOMIC_RELAXED);
+    }
+    if (held_count < MAX_HELD) {
+        held[held_count].mutex = mutex;
+        held[held_count].site = site;
+        held[held_count].acquired_at = now_ns();
+        held_count++;
+    }
+}
+
+void unlock(pthread_mutex_t* mutex) {
+    // Ищем запись о захвате (обычно она последняя)
+    for (int i = held_count - 1; i >= 0; i--) {
+        if (held[i].mutex != mutex) {
+            continue;
+        }
+        
+        if (stats_shared) {
+            LockStats* stats = &stats_shared->lock_stats[held[i].site];
+            uint64_t hold = now_ns() - held[i].acquired_at;
+            __atomic_fetch_add(&stats->hold_ns, hold, __ATOMIC_RELAXED);
+            record(stats->hold_hist, hold);
+        }
+        
+        held[i] = held[--held_count];
+        break;
+    }
+    
+    int ret = pthread_mutex_unlock(mutex);
+    if (ret != 0) {
+        fprintf(stderr, "Ошибка разблокировки мьютекса: %s\n", strerror(ret));
+        exit(1);
+    }
+}
+
+const char* lock_site_name(LockSite site) {
+    return site < LOCK_SITE_COUNT ? site_names[site] : "unknown";
+}
+
+uint64_t lock_hist_percentile(const uint32_t* hist, double pct) {
+    uint64_t total = 0;
+    for (int i = 0; i < LOCK_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = (uint64_t)(total * pct / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < LOCK_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank) {
+            return (uint64_t)1 << (i + 1);
+        }
+    }
+    return (uint64_t)1 << LOCK_HIST_BUCKETS;
+}
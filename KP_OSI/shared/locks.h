@@ -0,0 +1,31 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "protocol.h"
+
+// Статистика пишется в этот сегмент (вызвать после подключения)
+void locks_init(SharedData* shared);
+
+// Вызывается, когда мьютекс захвачен после смерти прежнего владельца
+// (мьютекс уже помечен консистентным и удерживается вызывающим)
+typedef void (*LockRecoverFn)(pthread_mutex_t* mutex);
+
+void locks_on_owner_death(LockRecoverFn fn);
+
+// Захват мьютекса с учетом ожидания в статистике места site.
+// EOWNERDEAD обрабатывается через LockRecoverFn, при других ошибках
+// процесс завершается
+void lock(pthread_mutex_t* mutex, LockSite site);
+
+// Освобождение; время удержания относится к месту, где мьютекс захвачен
+void unlock(pthread_mutex_t* mutex);
+
+// Название места захвата для вывода
+const char* lock_site_name(LockSite site);
+
+// Верхняя граница корзины, в которую попадает процентиль pct (0-100), в нс
+uint64_t lock_hist_percentile(const uint32_t* hist, double pct);
+
+#endif // LOCKS_H
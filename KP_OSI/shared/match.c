@@ -0,0 +1,50 @@
+#include "match.h"
+#include "arena.h"
+
+int match_rating(int wins, int losses) {
+    return (wins + 1) * 100 / (wins + losses + 2);
+}
+
+int match_enqueue(SharedData* shared, int channel, int player_idx, int rating) {
+    MatchTicket* tickets = arena_at(shared, shared->match_off);
+    uint32_t mask = shared->match_size - 1;
+    uint32_t pos = __atomic_load_n(&shared->match_tail, __ATOMIC_RELAXED);
+    
+    while (1) {
+        MatchTicket* ticket = &tickets[pos & mask];
+        uint32_t seq = __atomic_load_n(&ticket->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        
+        if (diff == 0) {
+            // Ячейка свободна: занимаем позицию, при неудаче pos обновится
+            if (__atomic_compare_exchange_n(&shared->match_tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                ticket->channel = channel;
+                ticket->player_idx = player_idx;
+                ticket->rating = rating;
+                __atomic_store_n(&ticket->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;  // Сервер еще не прочитал ячейку с прошлого круга
+        } else {
+            pos = __atomic_load_n(&shared->match_tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int match_dequeue(SharedData* shared, MatchTicket* ticket) {
+    MatchTicket* tickets = arena_at(shared, shared->match_off);
+    uint32_t pos = shared->match_head;
+    MatchTicket* cell = &tickets[pos & (shared->match_size - 1)];
+    
+    // Клиент мог занять позицию, но еще не дописать заявку
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return 0;
+    }
+    
+    *ticket = *cell;
+    __atomic_store_n(&cell->seq, pos + shared->match_size, __ATOMIC_RELEASE);
+    shared->match_head = pos + 1;
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include "protocol.h"
+
+// Рейтинг для подбора: процент побед со сглаживанием (у новичка 50)
+int match_rating(int wins, int losses);
+
+// Постановка заявки в очередь подбора без блокировок (клиент).
+// -1 если очередь заполнена
+int match_enqueue(SharedData* shared, int channel, int player_idx, int rating);
+
+// Извлечение следующей заявки (только сервер). 0 если очередь пуста
+int match_dequeue(SharedData* shared, MatchTicket* ticket);
+
+#endif // MATCH_H
@@ -0,0 +1,67 @@
+#ifndef MOVELOG_H
+#define MOVELOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+// Журнал ходов игры - кольцо с одним писателем (сервер под мьютексом игры)
+// и любым числом читателей. Читатель хранит свой курсор - номер следующего
+// хода - и ничего не пишет в общую память, поэтому ему хватает сегмента,
+// отображенного только для чтения
+
+// Запись хода читается и пишется одним 32-битным словом
+_Static_assert(sizeof(GameMove) == sizeof(uint32_t), "GameMove must be one 32-bit word");
+
+// Добавление хода (под мьютексом игры, внутри game_write_begin)
+static inline void movelog_append(Game* game, int player, int x, int y, int result) {
+    uint32_t count = game->move_count;
+    GameMove move = { .player = player, .x = x, .y = y, .result = result };
+    uint32_t raw;
+    memcpy(&raw, &move, sizeof(raw));
+    
+    uint32_t* slot = (uint32_t*)&game->moves[count % MOVE_LOG_SIZE];
+    __atomic_store_n(slot, raw, __ATOMIC_RELAXED);
+    __atomic_store_n(&game->move_count, count + 1, __ATOMIC_RELEASE);
+}
+
+// Ходы начиная с *cursor, не больше max. Возвращает число скопированных
+// ходов и сдвигает курсор. Отставший читатель теряет перезаписанные ходы:
+// курсор переходит на самый старый ход, который еще лежит в кольце
+static inline int movelog_read(const Game* game, uint32_t* cursor, GameMove* out, int max) {
+    uint32_t count = __atomic_load_n(&game->move_count, __ATOMIC_ACQUIRE);
+    
+    // Счетчик меньше курсора, если слот отдан новой игре
+    // или сервер откатил ход после падения
+    if (count < *cursor) {
+        *cursor = count;
+    }
+    if (count - *cursor > MOVE_LOG_SIZE) {
+        *cursor = count - MOVE_LOG_SIZE;
+    }
+    
+    int n = 0;
+    while (*cursor + n < count && n < max) {
+        const uint32_t* slot = (const uint32_t*)&game->moves[(*cursor + n) % MOVE_LOG_SIZE];
+        uint32_t raw = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        memcpy(&out[n], &raw, sizeof(raw));
+        n++;
+    }
+    
+    // Запись, которую писатель успел обогнать на целое кольцо, недостоверна
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t now = __atomic_load_n(&game->move_count, __ATOMIC_RELAXED);
+    uint32_t first_valid = now > MOVE_LOG_SIZE ? now - MOVE_LOG_SIZE : 0;
+    int skip = first_valid > *cursor ? (int)(first_valid - *cursor) : 0;
+    if (skip >= n) {
+        *cursor += n;
+        return 0;
+    }
+    if (skip > 0) {
+        memmove(out, out + skip, (n - skip) * sizeof(GameMove));
+    }
+    *cursor += n;
+    return n - skip;
+}
+
+#endif // MOVELOG_H
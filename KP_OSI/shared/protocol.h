@@ -2,21 +2,79 @@
 #define PROTOCOL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <pthread.h>
+#include <sys/types.h>
 
 // Конфигурация
 #define SHM_NAME "/sea_battle_shm"
 #define MMAP_FILE "/tmp/sea_battle.mmap"
-#define MMAP_SIZE (65536 + 1024)  // 64KB + доп место для мьютекса
 
-#define MAX_PLAYERS 20
-#define MAX_GAMES 10
+// Рукопожатие: клиент подключается только к сегменту той же версии.
+// Сервер, сохранивший состояние в снимок перед остановкой, ставит
+// SHM_RETIRED: клиенты ждут сегмент следующего запуска и входят в него
+#define SHM_MAGIC 12345
+#define SHM_RETIRED 54321
+#define SHM_VERSION 16
+
+// Сколько клиент ждет сегмент перезапущенного сервера
+#define REATTACH_WAIT_SEC 30
+
+// Емкость по умолчанию (переопределяется --max-players/--max-games
+// или SEA_BATTLE_MAX_PLAYERS/SEA_BATTLE_MAX_GAMES при запуске сервера)
+#define DEFAULT_MAX_PLAYERS 20
+#define DEFAULT_MAX_GAMES 10
+
+// Сегмент растет чанками по начальной емкости, не больше ARENA_MAX_CHUNKS раз
+#define ARENA_MAX_CHUNKS 16
+
 #define BOARD_SIZE 10
 #define MAX_SHIPS 10
 #define MAX_NAME 50
 #define MAX_LOGIN 30
 
+// Периодические задачи сервера (статус, очистка неактивных игроков)
+#define SERVER_TICK_SEC 10
+
+// Игрок без отметки активности дольше PRESENCE_TIMEOUT_SEC считается ушедшим.
+// Клиент обновляет отметку не чаще раза в HEARTBEAT_SEC
+#define PRESENCE_TIMEOUT_SEC 300
+#define HEARTBEAT_SEC 30
+
+// Клиент, ждущий соперника, раз в OPPONENT_CHECK_SEC проверяет, что тот
+// еще в игре и в сети
+#define OPPONENT_CHECK_SEC 5
+
+// Через сколько секунд после окончания игры ее слот возвращается в список свободных
+#define GAME_RECLAIM_SEC 30
+
+// Размер колец команд и ответов канала (степень двойки)
+#define CHANNEL_RING_SIZE 8
+
+// Подбор соперника: сервер объединяет ждущих раз в MATCH_ROUND_SEC.
+// Пара допустима при разнице рейтингов до MATCH_BAND_WIDTH, полоса
+// расширяется на столько же за каждый прожданный раунд.
+// Клиент ждет не дольше MATCH_WAIT_SEC
+#define MATCH_ROUND_SEC 1
+#define MATCH_BAND_WIDTH 10
+#define MATCH_WAIT_SEC 60
+
+// Ждущему без пары дольше MATCH_BOT_ROUNDS раундов сервер дает в соперники бота
+#define MATCH_BOT_ROUNDS 10
+
+// Журнал ходов игры (кольцо, степень двойки). Партия - не больше
+// 2 * BOARD_SIZE * BOARD_SIZE выстрелов, поэтому целиком помещается в кольцо
+#define MOVE_LOG_SIZE 256
+
+// Зритель, которого никто не будит, сам перечитывает журнал с таким периодом
+#define SPECTATE_POLL_MS 250
+
+// Размер кэш-линии. Поля, которые пишут разные процессы, разнесены по
+// разным линиям, чтобы запись одного не вытесняла данные, читаемые другим
+#define CACHE_LINE 64
+
 // Корабли по правилам: 1x4, 2x3, 3x2, 4x1
 #define BATTLESHIP_COUNT 1    // Линкор (4 клетки)
 #define CRUISER_COUNT 2       // Крейсера (3 клетки)
@@ -47,63 +105,354 @@ typedef enum {
     DIR_VERTICAL = 1
 } ShipDirection;
 
-// Структура игрока
+// Структура игрока. Занимает ровно одну кэш-линию: отметка активности
+// одного игрока не задевает записи соседей в массиве
 typedef struct {
+    _Alignas(CACHE_LINE) uint32_t seq;  // Seqlock для чтения без players_mutex (seqlock.h)
     char login[MAX_LOGIN];
+    bool online;
+    bool ships_placed;      // Расставил ли корабли
+    uint32_t login_hash;    // hash_string(login), считается один раз при регистрации
     int wins;
     int losses;
-    bool online;
     int game_id;            // ID игры, в которой участвует (-1 если нет)
-    time_t last_seen;
-    bool ships_placed;      // Расставил ли корабли
+    uint32_t game_gen;      // Поколение слота этой игры
+    time_t last_seen;       // Пишется атомарно без блокировок и вне seqlock
 } Player;
 
-// Структура корабля
+_Static_assert(sizeof(Player) == CACHE_LINE, "Player must fill exactly one cache line");
+
+// Битовая доска: клетка (x, y) - бит y * BOARD_SIZE + x, занято 100 бит из 128
+typedef unsigned __int128 Bitboard;
+
+// Флот одного игрока
+typedef struct {
+    Bitboard ships;                     // Клетки всех кораблей
+    Bitboard hits;                      // Попадания по кораблям
+    Bitboard misses;                    // Промахи
+    Bitboard sunk;                      // Клетки потопленных кораблей
+    Bitboard ship_mask[TOTAL_SHIPS];    // Клетки каждого корабля
+    uint8_t ship_at[BOARD_SIZE * BOARD_SIZE];  // Номер корабля в клетке + 1 (0 - пусто)
+    uint8_t ships_count;                // Количество расставленных кораблей
+    uint8_t ships_left;                 // Сколько кораблей еще не потоплено
+} Fleet;
+
+// Запись журнала ходов: выстрел игрока player (1 или 2) в клетку (x, y)
+typedef struct {
+    uint8_t player;
+    uint8_t x;
+    uint8_t y;
+    uint8_t result;         // 0 промах, 1 попадание, 2 корабль потоплен
+} GameMove;
+
+// Журнал отката игры: ее состояние до текущего изменения. Если владелец
+// мьютекса игры умер посреди изменения, сервер возвращает игру к нему
 typedef struct {
-    int size;               // Размер (1-4)
-    int hits;               // Количество попаданий
-    bool sunk;              // Потоплен ли
-    int cells[4][2];        // Координаты ячеек [размер][x,y]
-    int start_x;            // Начальная координата X
-    int start_y;            // Начальная координата Y
-    ShipDirection dir;      // Направление
-} Ship;
-
-// Структура игры
+    uint32_t active;        // 1 - изменение начато и не завершено
+    int fleet_idx;          // Какой флот сохранен в fleet (-1 - никакой)
+    bool in_use;
+    uint32_t generation;
+    GameStatus status;
+    int current_turn;
+    int winner;
+    time_t last_move;
+    time_t finished_at;
+    int player2_idx;
+    char player2[MAX_LOGIN];
+    uint32_t move_count;
+    Fleet fleet;
+} GameUndo;
+
+// Структура игры. Раскладка по кэш-линиям:
+//   1. mutex, seq и состояние партии - меняет сервер на каждом ходе
+//   2. move_seq и watchers - сюда пишут ждущие клиенты
+//   3. описание игры и служебные поля слота - меняются редко
+//   4. флоты
+//   5. журнал ходов - зрители читают его, не трогая остальные линии
+//   6. журнал отката
+// Размер кратен кэш-линии, соседние игры линий не делят
 typedef struct {
-    int id;
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;  // Защищает все поля игры
+    uint32_t seq;           // Seqlock: изменения под mutex, чтение без него (seqlock.h)
+    GameStatus status;
+    int current_turn;       // 1 - ход первого, 2 - ход второго
+    int winner;             // 0 - нет, 1 - player1, 2 - player2
+    time_t last_move;
+    
+    // Клиенты спят на move_seq (futex) и перерисовывают доски, когда
+    // сервер меняет игру. watchers - сколько процессов сейчас ждут
+    _Alignas(CACHE_LINE) uint32_t move_seq;
+    uint32_t watchers;
+    
+    _Alignas(CACHE_LINE) int id;
     char name[MAX_NAME];
+    uint32_t name_hash;     // hash_string(name)
     char player1[MAX_LOGIN];
     char player2[MAX_LOGIN];
+    int player1_idx;        // Индексы игроков (-1 если нет)
+    int player2_idx;
     
-    // Доски игроков
-    int board1[BOARD_SIZE][BOARD_SIZE];  // Доска первого игрока
-    int board2[BOARD_SIZE][BOARD_SIZE];  // Доска второго игрока
+    bool in_use;            // Слот выдан из списка свободных
+    uint32_t generation;    // Увеличивается при каждом освобождении слота
+    int next_free;          // Следующий свободный слот (-1 - конец списка)
+    int live_pos;           // Позиция в массиве живых игр
+    time_t finished_at;     // Когда сервер увидел GAME_FINISHED (0 - еще нет)
     
-    // Корабли игроков
-    Ship ships1[TOTAL_SHIPS];
-    Ship ships2[TOTAL_SHIPS];
-    int ships_count1;      // Количество расставленных кораблей
-    int ships_count2;
+    // Флоты игроков: fleet[0] - первого, fleet[1] - второго
+    _Alignas(CACHE_LINE) Fleet fleet[2];
     
-    GameStatus status;
-    int current_turn;      // 1 - ход первого, 2 - ход второго
-    int winner;            // 0 - нет, 1 - player1, 2 - player2
-    time_t last_move;
+    // Журнал ходов: сервер пишет запись moves[move_count % MOVE_LOG_SIZE],
+    // затем публикует ее, увеличивая move_count (RELEASE). Читается без
+    // мьютекса и seqlock (movelog.h)
+    _Alignas(CACHE_LINE) uint32_t move_count;
+    GameMove moves[MOVE_LOG_SIZE];
+    
+    _Alignas(CACHE_LINE) GameUndo undo;          // Пишет и читает только сервер под mutex
 } Game;
 
-// Главная структура shared memory
+_Static_assert(offsetof(Game, last_move) + sizeof(time_t) <= CACHE_LINE,
+               "Game turn state must share the cache line with its mutex");
+_Static_assert(offsetof(Game, move_seq) == CACHE_LINE,
+               "Game futex words must sit alone on the second cache line");
+_Static_assert(offsetof(Game, id) == 2 * CACHE_LINE,
+               "Game identity must start on its own cache line");
+_Static_assert((MOVE_LOG_SIZE & (MOVE_LOG_SIZE - 1)) == 0 &&
+               MOVE_LOG_SIZE >= 2 * BOARD_SIZE * BOARD_SIZE,
+               "Move log must be a power of two holding a whole game");
+_Static_assert(sizeof(Game) % CACHE_LINE == 0, "Game must be padded to whole cache lines");
+
+// Команды клиента серверу
+typedef enum {
+    CMD_LOGIN = 1,         // name - логин
+    CMD_CREATE_GAME = 2,   // name - имя игры
+    CMD_JOIN_GAME = 3,     // game_id
+    CMD_PLACE_SHIP = 4,    // x, y, dir (размер корабля определяет сервер)
+    CMD_SHOT = 5,          // x, y
+    CMD_LEAVE_GAME = 6,
+    CMD_LOGOUT = 7,
+    CMD_ADD_BOT = 8        // Бот вторым игроком в ожидающую игру создателя
+} CommandType;
+
+// Коды ответа
+typedef enum {
+    REPLY_OK = 0,
+    REPLY_FULL = -1,           // Нет свободных слотов
+    REPLY_NAME_TAKEN = -2,     // Имя игры занято
+    REPLY_NOT_AVAILABLE = -3,  // Игра не найдена или не принимает игроков
+    REPLY_CANNOT_PLACE = -4,   // Корабль нельзя поставить сюда
+    REPLY_BAD_COORDS = -5,
+    REPLY_ALREADY_SHOT = -6,
+    REPLY_NOT_YOUR_TURN = -7,
+    REPLY_BAD_STATE = -8,      // Команда не подходит к состоянию игры
+    REPLY_NOT_LOGGED_IN = -9,
+    REPLY_UNKNOWN = -10,
+    REPLY_ELSEWHERE = -11      // Игрок уже в сети на другом шарде (shard.h)
+} ReplyStatus;
+
+typedef struct {
+    uint32_t tag;           // Любое значение клиента, возвращается в ответе
+    uint8_t type;           // CommandType
+    uint8_t x;
+    uint8_t y;
+    uint8_t dir;            // ShipDirection
+    int32_t game_id;
+    char name[MAX_NAME];
+} Command;
+
+typedef struct {
+    uint32_t tag;
+    uint8_t type;           // Тип команды, на которую это ответ
+    int8_t status;          // ReplyStatus
+    int8_t player_num;      // 1 или 2 - сторона игрока в игре
+    int8_t shot_result;     // Результат process_shot (0 промах, 1 попадание, 2 потоплен)
+    int8_t game_status;     // GameStatus после команды
+    int8_t winner;          // 0 - нет, иначе номер победителя
+    int8_t is_new;          // CMD_LOGIN: игрок создан этой командой
+    int32_t player_idx;
+    int32_t game_id;        // Игра игрока (-1 если нет)
+    uint32_t game_gen;
+} Reply;
+
+// Состояние подбора соперника в канале (Channel.matching)
+typedef enum {
+    MATCH_IDLE = 0,         // Клиент не ищет соперника
+    MATCH_SEARCHING = 1,    // Заявка в очереди, клиент ждет
+    MATCH_CLAIMED = 2       // Сервер забрал заявку и создает игру
+} MatchState;
+
+// Заявка в очереди подбора (ограниченная MPSC-очередь: ячейка свободна
+// для записи, когда seq равен позиции, и готова к чтению при seq = позиция + 1)
+typedef struct {
+    uint32_t seq;
+    int32_t channel;
+    int32_t player_idx;
+    int32_t rating;
+} MatchTicket;
+
+// Канал клиента: два SPSC-кольца в shared memory.
+// Команды пишет только клиент-владелец и читает только сервер,
+// ответы - наоборот. Индексы растут бесконечно, позиция - индекс % размер.
+// Индексы клиента и сервера лежат в разных кэш-линиях
+typedef struct {
+    _Alignas(CACHE_LINE) pid_t owner_pid;  // 0 - канал свободен (захватывается через CAS)
+    int32_t player_idx;     // Игрок, вошедший через канал (-1 до CMD_LOGIN)
+    uint32_t cmd_tail;      // Пишет клиент
+    uint32_t reply_head;    // Пишет клиент
+    uint32_t matching;      // MatchState: клиент ставит и отменяет (CAS), сервер забирает (CAS)
+    uint32_t batched;       // 1 - канал шлюза: о новых ответах сообщает change_seq
+    
+    _Alignas(CACHE_LINE) uint32_t cmd_head;  // Пишет сервер
+    uint32_t reply_tail;    // Пишет сервер; futex, на котором клиент ждет ответ
+    uint32_t match_seq;     // Пишет сервер; futex: подбор соперника закончен
+    
+    _Alignas(CACHE_LINE) Command commands[CHANNEL_RING_SIZE];
+    _Alignas(CACHE_LINE) Reply replies[CHANNEL_RING_SIZE];
+} Channel;
+
+_Static_assert(offsetof(Channel, cmd_head) == CACHE_LINE,
+               "Channel server indices must not share a cache line with client indices");
+
+// Места захвата мьютексов, по которым ведется статистика блокировок
+typedef enum {
+    LOCK_SERVER_CREATE_GAME,    // Создание игры: список игр и новая игра
+    LOCK_SERVER_RECLAIM,        // Освобождение завершенной игры
+    LOCK_SERVER_GAME_COMMAND,   // Команда игрока над его игрой
+    LOCK_SERVER_PLAYERS,        // Изменение таблицы игроков сервером
+    LOCK_SERVER_RECOVERY,       // Проверка мьютексов при запуске сервера
+    LOCK_SERVER_SNAPSHOT,       // Снимок состояния при остановке сервера
+    LOCK_SITE_COUNT
+} LockSite;
+
+// Гистограммы по степеням двойки наносекунд: корзина i - [2^i, 2^(i+1))
+#define LOCK_HIST_BUCKETS 32
+
+// Статистика одного места захвата (обновляется атомарно всеми процессами,
+// поэтому каждое место в своих кэш-линиях)
 typedef struct {
-    Player players[MAX_PLAYERS];
-    Game games[MAX_GAMES];
+    _Alignas(CACHE_LINE) uint64_t acquired;  // Сколько раз захвачен
+    uint64_t contended;             // Сколько раз пришлось ждать
+    uint64_t wait_ns;               // Суммарное ожидание
+    uint64_t hold_ns;               // Суммарное удержание
+    uint64_t owner_died;            // Сколько раз захвачен после смерти владельца
+    uint32_t wait_hist[LOCK_HIST_BUCKETS];
+    uint32_t hold_hist[LOCK_HIST_BUCKETS];
+} LockStats;
+
+// Заголовок сегмента shared memory. За ним в том же сегменте лежат
+// хеш-индексы, каналы клиентов и чанки с Player и Game.
+// Все ссылки внутри сегмента - смещения от начала заголовка, поэтому
+// сегмент можно отображать по разным адресам в разных процессах.
+//
+// Порядок захвата мьютексов (во избежание взаимоблокировок):
+//   1. mutex          - список игр: game_count, free_game, живые игры, индекс игр
+//                       (берет только сервер; клиенты читают массив живых игр
+//                       без блокировки, сверяя live_seq)
+//   2. Game.mutex     - состояние одной игры (две игры сразу не блокируются)
+//   3. players_mutex  - таблица игроков
+//   4. arena_mutex    - рост сегмента (arena_size, таблицы чанков)
+// Любой из уровней можно пропустить, но брать их только в этом порядке.
+//
+// Сначала идут поля, которые почти не меняются после инициализации.
+// Часто записываемые поля сгруппированы по писателю, и каждая группа,
+// как и каждый мьютекс, занимает свои кэш-линии.
+// Клиенты мьютексы игр не берут: Game и Player читаются через seqlock,
+// который писатель увеличивает под соответствующим мьютексом.
+// game_count, player_count и *_chunks читаются без мьютекса через
+// __atomic_load (ACQUIRE), записываются через __atomic_store (RELEASE).
+typedef struct {
+    int initialized;               // SHM_MAGIC после инициализации
+    uint32_t version;              // SHM_VERSION
+    uint32_t epoch;                // Номер запуска: следующий после сервера, записавшего снимок
+                                   // (0 - сервер еще загружает снимок)
+    
+    // Арена
+    uint64_t arena_size;           // Текущий размер сегмента (ftruncate)
+    uint64_t arena_max_size;       // Размер при всех чанках - столько адресов резервирует каждый процесс
+    uint64_t arena_align;          // Выравнивание роста сегмента (размер страницы)
+    uint32_t generation;           // Увеличивается при каждом росте сегмента
+    uint32_t prefaulted;           // Сервер заполняет и закрепляет (mlock) страницы сегмента
+    
+    uint32_t players_per_chunk;
+    uint32_t games_per_chunk;
+    uint32_t player_chunks;        // Выделено чанков
+    uint32_t game_chunks;
+    uint64_t player_chunk_off[ARENA_MAX_CHUNKS];
+    uint64_t game_chunk_off[ARENA_MAX_CHUNKS];
+    
+    // Хеш-индексы с открытой адресацией: хранят индекс записи + 1 (0 - пусто).
+    // Индекс игроков защищен players_mutex, индекс игр - mutex
+    uint64_t player_index_off;
+    uint32_t player_index_size;    // Степень двойки
+    uint64_t game_index_off;
+    uint32_t game_index_size;
+    
+    // Каналы клиентов. Отправив команду, клиент помечает канал в битовой
+    // карте pending_off, увеличивает event_seq и будит сервер через futex
+    uint64_t channels_off;
+    uint32_t channel_count;
+    uint64_t pending_off;
+    uint32_t pending_words;
+    
+    // Каналы шлюзов (Channel.batched) с новыми ответами: сервер ставит бит
+    // в карте ready_off (pending_words слов), шлюз снимает биты своих каналов
+    uint64_t ready_off;
     
-    int player_count;
-    int game_count;
+    // Живые игры - плотный массив id, чтобы обходить только занятые слоты.
+    // live_seq нечетный, пока сервер меняет массив
+    uint64_t live_off;
+    
+    // Очередь подбора соперника: match_size ячеек MatchTicket
+    uint64_t match_off;
+    uint32_t match_size;           // Степень двойки
     
-    // Мьютекс для синхронизации
-    pthread_mutex_t mutex;
     pthread_mutexattr_t mutex_attr;
-    int initialized;
+    
+    // Пишут все клиенты на каждой команде
+    _Alignas(CACHE_LINE) uint32_t event_seq;
+    uint32_t server_sleeping;      // 1 - сервер спит в futex_wait
+    
+    // Пишет сервер раз за итерацию цикла: шлюзы ждут на change_seq (futex)
+    // ответы своих каналов и изменения игр. change_waiters - сколько их спит
+    _Alignas(CACHE_LINE) uint32_t change_seq;
+    uint32_t change_waiters;
+    
+    // Конец очереди подбора: клиенты занимают позицию через CAS
+    _Alignas(CACHE_LINE) uint32_t match_tail;
+    
+    // Пишет сервер, читают клиенты
+    _Alignas(CACHE_LINE) uint32_t live_seq;
+    int live_count;
+    int player_count;              // Зарегистрировано игроков
+    int game_count;                // Граница выданных слотов игр (max id + 1)
+    int free_game;                 // Голова списка свободных слотов игр (-1 - пуст)
+    uint32_t match_head;           // Начало очереди подбора (читает только сервер)
+    
+    // Мьютексы для синхронизации
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;          // Список игр
+    _Alignas(CACHE_LINE) pthread_mutex_t players_mutex;  // Таблица игроков
+    _Alignas(CACHE_LINE) pthread_mutex_t arena_mutex;    // Рост сегмента
+    
+    // Страничные ошибки сервера (getrusage): пишет сервер раз в тик.
+    // setup_minflt - сколько их было к концу подготовки сегмента
+    _Alignas(CACHE_LINE) uint64_t server_minflt;
+    uint64_t server_majflt;
+    uint64_t setup_minflt;
+    
+    // Статистика блокировок по местам захвата (sea_battle_server --stats)
+    LockStats lock_stats[LOCK_SITE_COUNT];
 } SharedData;
 
+_Static_assert(offsetof(SharedData, event_seq) % CACHE_LINE == 0 &&
+               offsetof(SharedData, change_seq) % CACHE_LINE == 0 &&
+               offsetof(SharedData, live_seq) % CACHE_LINE == 0,
+               "SharedData hot counters must start their own cache lines");
+_Static_assert(offsetof(SharedData, mutex) % CACHE_LINE == 0 &&
+               offsetof(SharedData, players_mutex) % CACHE_LINE == 0 &&
+               offsetof(SharedData, arena_mutex) % CACHE_LINE == 0 &&
+               sizeof(pthread_mutex_t) <= CACHE_LINE,
+               "Each SharedData mutex must have a cache line of its own");
+_Static_assert(offsetof(SharedData, mutex) - offsetof(SharedData, live_seq) >= CACHE_LINE,
+               "Games list mutex must not share a line with game_count");
+_Static_assert(sizeof(LockStats) % CACHE_LINE == 0, "LockStats must be padded to whole cache lines");
+
 #endif // PROTOCOL_H
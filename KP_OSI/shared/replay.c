@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include "replay.h"
+
+static int write_all(int fd, const void* data, size_t size) {
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n < 0) {
+            return -1;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int replay_save(const char* dir, const Game* game, int winner) {
+    ReplayHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = REPLAY_MAGIC;
+    header.version = REPLAY_VERSION;
+    memcpy(header.name, game->name, MAX_NAME);
+    memcpy(header.player1, game->player1, MAX_LOGIN);
+    memcpy(header.player2, game->player2, MAX_LOGIN);
+    header.winner = winner;
+    header.finished_at = time(NULL);
+    
+    // Партия целиком помещается в кольцо, поэтому ходы идут с нулевого
+    header.move_count = game->move_count < MOVE_LOG_SIZE ? game->move_count : MOVE_LOG_SIZE;
+    for (int p = 0; p < 2; p++) {
+        header.ships_count[p] = game->fleet[p].ships_count;
+        memcpy(header.ship_mask[p], game->fleet[p].ship_mask, sizeof(header.ship_mask[p]));
+    }
+    
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 4];
+    snprintf(path, sizeof(path), "%s/game-%lld-%d-%u.replay",
+             dir, (long long)header.finished_at, game->id, game->generation);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    
+    // Читатель видит либо весь файл, либо никакого
+    int fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror("replay open failed");
+        return -1;
+    }
+    
+    int ret = write_all(fd, &header, sizeof(header));
+    if (ret == 0) {
+        ret = write_all(fd, game->moves, header.move_count * sizeof(GameMove));
+    }
+    close(fd);
+    
+    if (ret < 0 || rename(tmp_path, path) < 0) {
+        perror("replay write failed");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int replay_load(const char* path, ReplayHeader* header, GameMove* moves) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    int ret = -2;
+    if (read(fd, header, sizeof(*header)) == sizeof(*header) &&
+        header->magic == REPLAY_MAGIC && header->version == REPLAY_VERSION &&
+        header->move_count <= MOVE_LOG_SIZE &&
+        header->ships_count[0] <= TOTAL_SHIPS && header->ships_count[1] <= TOTAL_SHIPS) {
+        size_t size = header->move_count * sizeof(GameMove);
+        if (read(fd, moves, size) == (ssize_t)size) {
+            header->name[MAX_NAME - 1] = '\0';
+            header->player1[MAX_LOGIN - 1] = '\0';
+            header->player2[MAX_LOGIN - 1] = '\0';
+            ret = 0;
+        }
+    }
+    
+    close(fd);
+    return ret;
+}
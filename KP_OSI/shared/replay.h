@@ -0,0 +1,34 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+#define REPLAY_MAGIC 0x53425250u  // "SBRP"
+#define REPLAY_VERSION 1
+
+// Заголовок файла повтора, за ним move_count записей GameMove.
+// Расстановка хранится масками кораблей, доски восстанавливаются
+// через fleet_add_ship, а ходы проигрываются через fleet_shot
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char name[MAX_NAME];
+    char player1[MAX_LOGIN];
+    char player2[MAX_LOGIN];
+    int32_t winner;
+    uint32_t move_count;
+    int64_t finished_at;
+    uint32_t ships_count[2];
+    Bitboard ship_mask[2][TOTAL_SHIPS];
+} ReplayHeader;
+
+// Запись завершенной игры в каталог dir (сервер, под мьютексом игры).
+// Имя файла: game-<время>-<id>-<поколение>.replay
+int replay_save(const char* dir, const Game* game, int winner);
+
+// Чтение повтора. moves должен вмещать MOVE_LOG_SIZE записей.
+// -1 если файл не открылся, -2 если это не повтор или он поврежден
+int replay_load(const char* path, ReplayHeader* header, GameMove* moves);
+
+#endif // REPLAY_H
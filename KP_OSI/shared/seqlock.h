@@ -0,0 +1,55 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include "protocol.h"
+
+// Счетчик последовательности: нечетный, пока идет запись.
+// Писатель меняет данные под обычным мьютексом и обрамляет изменения
+// seqlock_write_begin/end; читатель копирует данные без блокировки и
+// повторяет копирование, если счетчик изменился или был нечетным.
+// Читатели ничего не пишут в общую память
+
+static inline void seqlock_write_begin(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t seqlock_read_begin(const uint32_t* seq) {
+    uint32_t value;
+    while ((value = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        sched_yield();
+    }
+    return value;
+}
+
+static inline int seqlock_read_retry(const uint32_t* seq, uint32_t value) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != value;
+}
+
+// Согласованная копия игры без мьютекса игры
+static inline void game_snapshot(const Game* game, Game* copy) {
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&game->seq);
+        memcpy(copy, game, sizeof(*copy));
+    } while (seqlock_read_retry(&game->seq, seq));
+}
+
+// Согласованная копия игрока без players_mutex
+static inline void player_snapshot(const Player* player, Player* copy) {
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&player->seq);
+        memcpy(copy, player, sizeof(*copy));
+    } while (seqlock_read_retry(&player->seq, seq));
+}
+
+#endif // SEQLOCK_H
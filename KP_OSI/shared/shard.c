@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shard.h"
+
+void shard_shm_name(char* buf, size_t size, int shard, int shard_count) {
+    if (shard_count > 1) {
+        snprintf(buf, size, "%s.%d", SHM_NAME, shard);
+    } else {
+        snprintf(buf, size, "%s", SHM_NAME);
+    }
+}
+
+void shard_mmap_file(char* buf, size_t size, int shard, int shard_count) {
+    if (shard_count > 1) {
+        snprintf(buf, size, "%s.%d", MMAP_FILE, shard);
+    } else {
+        snprintf(buf, size, "%s", MMAP_FILE);
+    }
+}
+
+int shard_open(int shard, int shard_count, int flags) {
+    char name[64];
+    shard_shm_name(name, sizeof(name), shard, shard_count);
+    int fd = shm_open(name, flags, 0666);
+    if (fd < 0) {
+        shard_mmap_file(name, sizeof(name), shard, shard_count);
+        fd = open(name, flags, 0666);
+    }
+    return fd;
+}
+
+// Каталог отображается целиком; fd после отображения не нужен
+static Directory* directory_map(int fd, int prot) {
+    void* base = mmap(NULL, sizeof(Directory), prot, MAP_SHARED, fd, 0);
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+static int directory_open_fd(int flags) {
+    int fd = shm_open(DIR_SHM_NAME, flags, 0666);
+    if (fd < 0 && errno != EEXIST) {
+        fd = open(DIR_MMAP_FILE, flags, 0666);
+    }
+    return fd;
+}
+
+static void directory_unlink() {
+    shm_unlink(DIR_SHM_NAME);
+    unlink(DIR_MMAP_FILE);
+}
+
+static bool shard_alive(const ShardInfo* info) {
+    return info->pid > 0 && (kill(info->pid, 0) == 0 || errno != ESRCH);
+}
+
+// Отметки и таблица шардов меняются одной записью, поэтому после
+// смерти владельца мьютекс достаточно пометить консистентным
+static void directory_lock(Directory* dir) {
+    if (pthread_mutex_lock(&dir->mutex) == EOWNERDEAD) {
+        pthread_mutex_consistent(&dir->mutex);
+    }
+}
+
+static void directory_unlock(Directory* dir) {
+    pthread_mutex_unlock(&dir->mutex);
+}
+
+// Новый каталог создает ровно один сервер (O_EXCL), остальные ждут,
+// пока он будет инициализирован
+static Directory* directory_init(int fd, int shard_count) {
+    if (ftruncate(fd, sizeof(Directory)) < 0) {
+        perror("ftruncate failed");
+        close(fd);
+        return NULL;
+    }
+    Directory* dir = directory_map(fd, PROT_READ | PROT_WRITE);
+    if (!dir) {
+        perror("mmap failed");
+        return NULL;
+    }
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&dir->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    
+    dir->version = DIR_VERSION;
+    dir->shard_count = shard_count;
+    for (int i = 0; i < MAX_SHARDS; i++) {
+        dir->shards[i].cpu = -1;
+    }
+    __atomic_store_n(&dir->initialized, DIR_MAGIC, __ATOMIC_RELEASE);
+    return dir;
+}
+
+// Подключение к каталогу с DIR_MAGIC. Создатель мог еще не задать размер
+// файла или не закончить инициализацию, поэтому и того и другого ждем
+// не дольше DIR_ATTACH_WAIT_MS. NULL, если каталог так и не готов.
+// Версию проверяет вызывающий
+static Directory* directory_attach(int fd, int prot) {
+    int waited = 0;
+    struct stat st;
+    while (fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(Directory) &&
+           waited < DIR_ATTACH_WAIT_MS) {
+        usleep(10000);
+        waited += 10;
+    }
+    if ((size_t)st.st_size < sizeof(Directory)) {
+        close(fd);
+        return NULL;
+    }
+    Directory* dir = directory_map(fd, prot);
+    if (!dir) {
+        return NULL;
+    }
+    
+    while (__atomic_load_n(&dir->initialized, __ATOMIC_ACQUIRE) != DIR_MAGIC &&
+           waited < DIR_ATTACH_WAIT_MS) {
+        usleep(10000);
+        waited += 10;
+    }
+    if (__atomic_load_n(&dir->initialized, __ATOMIC_ACQUIRE) != DIR_MAGIC) {
+        munmap(dir, sizeof(Directory));
+        return NULL;
+    }
+    return dir;
+}
+
+Directory* directory_create(int shard_count) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = directory_open_fd(O_CREAT | O_EXCL | O_RDWR);
+        if (fd >= 0) {
+            return directory_init(fd, shard_count);
+        }
+        
+        fd = directory_open_fd(O_RDWR);
+        if (fd < 0) {
+            perror("Failed to open shard directory");
+            return NULL;
+        }
+        // Неготовый каталог может еще инициализировать другой сервер,
+        // запущенный одновременно с этим: такой каталог не удаляем
+        Directory* dir = directory_attach(fd, PROT_READ | PROT_WRITE);
+        if (!dir) {
+            fprintf(stderr, "Shard directory is not initialized (remove %s if its creator died)\n",
+                    DIR_SHM_NAME);
+            return NULL;
+        }
+        if (dir->version == DIR_VERSION && dir->shard_count == (uint32_t)shard_count) {
+            return dir;
+        }
+        
+        // Каталог прошлой раскладки или версии можно заменить, только
+        // если ни один из его серверов не работает
+        bool busy = false;
+        for (int i = 0; i < MAX_SHARDS; i++) {
+            busy |= shard_alive(&dir->shards[i]);
+        }
+        munmap(dir, sizeof(Directory));
+        if (busy) {
+            fprintf(stderr, "Shard directory is in use by servers with a different shard count\n");
+            return NULL;
+        }
+        directory_unlink();
+    }
+    return NULL;
+}
+
+Directory* directory_open() {
+    int fd = directory_open_fd(O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    Directory* dir = directory_attach(fd, PROT_READ);
+    if (dir && dir->version != DIR_VERSION) {
+        munmap(dir, sizeof(Directory));
+        return NULL;
+    }
+    return dir;
+}
+
+void directory_close(Directory* dir) {
+    if (dir) {
+        munmap(dir, sizeof(Directory));
+    }
+}
+
+// Каталог, оставшийся после аварийной остановки серверов, не считается
+int shard_count_lookup() {
+    Directory* dir = directory_open();
+    int count = 1;
+    for (int i = 0; dir && i < MAX_SHARDS; i++) {
+        if (shard_alive(&dir->shards[i])) {
+            count = (int)dir->shard_count;
+            break;
+        }
+    }
+    directory_close(dir);
+    return count;
+}
+
+// Ячейка логина или первая свободная ячейка на пути пробирования (под mutex)
+static DirPlayer* registry_slot(Directory* dir, const char* login, uint32_t hash) {
+    uint32_t mask = DIR_REGISTRY_SIZE - 1;
+    for (uint32_t i = 0, pos = hash & mask; i < DIR_REGISTRY_SIZE; i++, pos = (pos + 1) & mask) {
+        DirPlayer* entry = &dir->registry[pos];
+        if (entry->login[0] == '\0' ||
+            (entry->hash == hash && strcmp(entry->login, login) == 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int directory_claim(Directory* dir, const char* login, uint32_t hash, int shard) {
+    int ret = 0;
+    directory_lock(dir);
+    
+    DirPlayer* entry = registry_slot(dir, login, hash);
+    if (!entry) {
+        ret = -2;
+    } else if (entry->login[0] == '\0') {
+        entry->hash = hash;
+        strncpy(entry->login, login, MAX_LOGIN - 1);
+        entry->shard = shard;
+    } else if (entry->shard >= 0 && entry->shard != shard &&
+               shard_alive(&dir->shards[entry->shard])) {
+        ret = -1;
+    } else {
+        entry->shard = shard;
+    }
+    
+    directory_unlock(dir);
+    return ret;
+}
+
+void directory_release(Directory* dir, const char* login, uint32_t hash, int shard) {
+    directory_lock(dir);
+    DirPlayer* entry = registry_slot(dir, login, hash);
+    if (entry && entry->login[0] != '\0' && entry->shard == shard) {
+        entry->shard = -1;
+    }
+    directory_unlock(dir);
+}
+
+void directory_register_shard(Directory* dir, int shard, int cpu) {
+    directory_lock(dir);
+    for (int i = 0; i < DIR_REGISTRY_SIZE; i++) {
+        if (dir->registry[i].shard == shard) {
+            dir->registry[i].shard = -1;
+        }
+    }
+    dir->shards[shard].pid = getpid();
+    dir->shards[shard].cpu = cpu;
+    directory_unlock(dir);
+}
+
+void directory_unregister_shard(Directory* dir, int shard) {
+    directory_lock(dir);
+    for (int i = 0; i < DIR_REGISTRY_SIZE; i++) {
+        if (dir->registry[i].shard == shard) {
+            dir->registry[i].shard = -1;
+        }
+    }
+    dir->shards[shard].pid = 0;
+    dir->shards[shard].cpu = -1;
+    
+    // Последний остановившийся сервер удаляет каталог
+    bool busy = false;
+    for (int i = 0; i < MAX_SHARDS; i++) {
+        busy |= shard_alive(&dir->shards[i]);
+    }
+    if (!busy) {
+        directory_unlink();
+    }
+    directory_unlock(dir);
+}
@@ -0,0 +1,92 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "protocol.h"
+
+// Шардирование: игры делятся между несколькими серверами, у каждого
+// свой сегмент (SHM_NAME с суффиксом ".<номер шарда>") и свое ядро.
+// Игра живет на шарде hash(имя) % shard_count, игрок входит на шард
+// hash(логин) % shard_count и переходит на шард игры при создании
+// и присоединении. Общий для всех серверов каталог хранит раскладку
+// и реестр игроков: на каком шарде игрок сейчас в сети.
+// Без каталога работает один сервер с сегментом SHM_NAME без суффикса
+#define DIR_SHM_NAME "/sea_battle_dir"
+#define DIR_MMAP_FILE "/tmp/sea_battle_dir.mmap"
+#define DIR_MAGIC 0x53424452u       // "SBDR"
+#define DIR_VERSION 1
+
+// Сколько подключающийся ждет, пока создатель инициализирует каталог
+#define DIR_ATTACH_WAIT_MS 2000
+
+#define MAX_SHARDS 16
+
+// Реестр игроков - хеш-таблица с открытой адресацией (степень двойки).
+// Записи не удаляются: вышедший игрок остается с shard = -1
+#define DIR_REGISTRY_SIZE 65536
+
+// Глобальный id игры: локальный id слота и номер шарда
+#define SHARD_GAME_ID(local_id, shard, count) ((local_id) * (count) + (shard))
+
+typedef struct {
+    pid_t pid;              // Сервер шарда (0 - не запущен)
+    int cpu;                // Ядро, к которому он привязан (-1 - не привязан)
+} ShardInfo;
+
+typedef struct {
+    uint32_t hash;          // hash_string(login)
+    int32_t shard;          // Шард, на котором игрок в сети (-1 - не в сети)
+    char login[MAX_LOGIN];  // Пустая строка - ячейка свободна
+} DirPlayer;
+
+// Сегмент каталога. Пишут только серверы шардов, под mutex
+typedef struct {
+    uint32_t initialized;   // DIR_MAGIC после инициализации
+    uint32_t version;       // DIR_VERSION
+    uint32_t shard_count;
+    pthread_mutex_t mutex;  // Реестр игроков и shards[]
+    ShardInfo shards[MAX_SHARDS];
+    DirPlayer registry[DIR_REGISTRY_SIZE];
+} Directory;
+
+// Имя сегмента и файла-замены шарда (без суффикса при shard_count <= 1)
+void shard_shm_name(char* buf, size_t size, int shard, int shard_count);
+void shard_mmap_file(char* buf, size_t size, int shard, int shard_count);
+
+// Открытие сегмента шарда (flags - O_RDONLY или O_RDWR, с O_CREAT у сервера)
+int shard_open(int shard, int shard_count, int flags);
+
+// Каталог: создание или подключение (сервер). NULL при ошибке или если
+// каталог создан для другого числа шардов, а его серверы еще работают
+Directory* directory_create(int shard_count);
+
+// Подключение только для чтения, NULL если каталога нет (один сервер)
+Directory* directory_open();
+
+void directory_close(Directory* dir);
+
+// Число шардов: из каталога, 1 если каталога нет или ни один
+// из его серверов не работает
+int shard_count_lookup();
+
+static inline int shard_of(uint32_t hash, int shard_count) {
+    return shard_count > 1 ? (int)(hash % (uint32_t)shard_count) : 0;
+}
+
+// Отметка игрока в реестре: 0 - игрок отмечен на шарде shard,
+// -1 - он в сети на другом работающем шарде, -2 - реестр заполнен
+int directory_claim(Directory* dir, const char* login, uint32_t hash, int shard);
+
+// Снятие отметки, если игрок отмечен на шарде shard
+void directory_release(Directory* dir, const char* login, uint32_t hash, int shard);
+
+// Запуск сервера шарда: его прежние отметки снимаются, pid и ядро записываются
+void directory_register_shard(Directory* dir, int shard, int cpu);
+
+// Остановка сервера шарда; последний сервер удаляет каталог
+void directory_unregister_shard(Directory* dir, int shard);
+
+#endif // SHARD_H
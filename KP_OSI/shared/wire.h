@@ -0,0 +1,101 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Протокол шлюза (sea_battle_gateway) для клиентов через сокеты.
+// Сообщение - WireHeader и length байт тела. Числа передаются в порядке
+// байт хоста: шлюз рассчитан на клиентов той же машины (TCP на loopback
+// или Unix-сокет)
+
+// Адреса шлюза по умолчанию
+#define GATEWAY_PORT 7070
+#define GATEWAY_SOCKET "/tmp/sea_battle_gateway.sock"
+
+// Самое длинное тело сообщения
+#define WIRE_MAX_BODY 512
+
+typedef enum {
+    WIRE_COMMAND = 1,       // WireCommand -> WIRE_REPLY
+    WIRE_REPLY = 2,         // WireReply
+    WIRE_GAME = 3,          // WireGameQuery -> WIRE_GAME_STATE сразу
+    WIRE_WAIT_GAME = 4,     // WireGameQuery -> WIRE_GAME_STATE, когда move_seq игры != seen_seq
+    WIRE_GAME_STATE = 5,    // WireGame
+    WIRE_ERROR = 6          // WireError
+} WireType;
+
+typedef enum {
+    WIRE_ERR_BAD_MESSAGE = 1,   // Неизвестный тип или неверная длина
+    WIRE_ERR_NO_CHANNEL = 2,    // У сервера нет свободных каналов
+    WIRE_ERR_NO_GAME = 3        // Игры с таким id нет
+} WireErrorCode;
+
+typedef struct __attribute__((packed)) {
+    uint16_t length;        // Размер тела
+    uint8_t type;           // WireType
+    uint8_t reserved;
+    uint32_t tag;           // Любое значение клиента, возвращается в ответе
+} WireHeader;
+
+// Command без тега; name передается только в name_len байтах
+typedef struct __attribute__((packed)) {
+    uint8_t type;           // CommandType
+    uint8_t x;
+    uint8_t y;
+    uint8_t dir;
+    int32_t game_id;
+    uint8_t name_len;
+    char name[MAX_NAME - 1];
+} WireCommand;
+
+#define WIRE_COMMAND_MIN offsetof(WireCommand, name)
+
+// Reply без тега (тег - в заголовке)
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    int8_t status;
+    int8_t player_num;
+    int8_t shot_result;
+    int8_t game_status;
+    int8_t winner;
+    int8_t is_new;
+    int32_t player_idx;
+    int32_t game_id;
+    uint32_t game_gen;
+} WireReply;
+
+typedef struct __attribute__((packed)) {
+    int32_t game_id;
+    uint32_t seen_seq;      // Только для WIRE_WAIT_GAME
+} WireGameQuery;
+
+// Снимок игры. Корабли соперника не передаются: у каждого флота
+// только попадания, промахи и потопленные клетки
+typedef struct __attribute__((packed)) {
+    int32_t game_id;
+    uint32_t generation;
+    uint32_t move_seq;      // Для следующего WIRE_WAIT_GAME
+    uint8_t in_use;
+    uint8_t status;         // GameStatus
+    uint8_t current_turn;
+    uint8_t winner;
+    uint8_t player_num;     // Сторона игрока соединения (0 - зритель)
+    uint8_t ships_left[2];
+    char name[MAX_NAME];
+    char player1[MAX_LOGIN];
+    char player2[MAX_LOGIN];
+    Bitboard own_ships;     // Корабли игрока соединения (0 для зрителя)
+    Bitboard hits[2];
+    Bitboard misses[2];
+    Bitboard sunk[2];
+} WireGame;
+
+typedef struct __attribute__((packed)) {
+    uint8_t code;           // WireErrorCode
+} WireError;
+
+_Static_assert(sizeof(WireCommand) <= WIRE_MAX_BODY && sizeof(WireGame) <= WIRE_MAX_BODY,
+               "Wire messages must fit WIRE_MAX_BODY");
+
+#endif // WIRE_H